@@ -0,0 +1,322 @@
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <stdexcept>
+#include <random>
+#include <cmath>
+
+#include <boost/program_options.hpp>
+
+#include <TTree.h>
+#include <TH1.h>
+#include <TAxis.h>
+#include <TMemFile.h>
+
+#include <fastjet/ClusterSequence.hh>
+
+#include "LHAPDF/LHAPDF.h"
+
+#include "BHEvent.hh"
+#include "rew_calc.hh"
+#include "weight.hh"
+#include "csshists.hh"
+#include "hist.hh"
+#include "small_cluster.hh"
+#include "bhgen.hh"
+
+using namespace std;
+namespace po = boost::program_options;
+
+BHEvent event; // extern
+
+// Timing ***********************************************************
+
+typedef chrono::steady_clock bench_clock;
+
+// Results are printed as one JSON object per line
+class result {
+  stringstream ss;
+public:
+  result(const char* bench) { ss << "{\"bench\":\"" << bench << '\"'; }
+
+  template<class T>
+  result& operator()(const char* key, const T& val) {
+    ss << ",\"" << key << "\":" << val;
+    return *this;
+  }
+  result& operator()(const char* key, char val) {
+    ss << ",\"" << key << "\":\"" << val << '\"';
+    return *this;
+  }
+
+  void prt(Long64_t n, double ns) {
+    cout << ss.str() << ",\"n\":" << n
+         << ",\"ns_per_event\":" << ns/n
+         << ",\"events_per_s\":" << n*1e9/ns << '}' << endl;
+  }
+};
+
+// Keeps the compiler from merging consecutive event copies
+inline void barrier() noexcept { asm volatile("" ::: "memory"); }
+
+// Time n iterations of fcn over the pool of events
+// Cost of setting the current event is subtracted
+template<class F>
+double run(const vector<BHEvent>& pool, Long64_t n, F fcn) {
+  const size_t size = pool.size();
+
+  auto start = bench_clock::now();
+  for (Long64_t i=0; i<n; ++i) {
+    event = pool[i%size];
+    barrier();
+  }
+  const double ref = chrono::duration<double,nano>(
+    bench_clock::now() - start ).count();
+
+  start = bench_clock::now();
+  for (Long64_t i=0; i<n; ++i) {
+    event = pool[i%size];
+    barrier();
+    fcn();
+  }
+  const double ns = chrono::duration<double,nano>(
+    bench_clock::now() - start ).count();
+
+  return (ns > ref ? ns - ref : 0.);
+}
+
+size_t sink = 0; // prevents optimizing away benchmarked code
+
+// ******************************************************************
+int main(int argc, char** argv)
+{
+  // START OPTIONS **************************************************
+  string pdf_name, css_file;
+  vector<Int_t> nps;
+  vector<unsigned> nws;
+  vector<char> parts;
+  Long64_t niter;
+  size_t npool;
+  unsigned seed;
+  bool pdf_unc;
+
+  try {
+    // General Options ------------------------------------
+    po::options_description desc("Options");
+    desc.add_options()
+      ("help,h", "produce help message")
+      ("pdf", po::value<string>(&pdf_name)->default_value("CT10nlo"),
+       "LHAPDF set name")
+      ("pdfunc", po::bool_switch(&pdf_unc),
+       "also benchmark PDF uncertainties (loads all members)")
+      ("style,s", po::value<string>(&css_file)
+       ->default_value(CONFDIR"/H3j.css","H3j.css"),
+       "CSS style file for histogram booking")
+      ("np", po::value<vector<Int_t>>(&nps)->multitoken()
+       ->default_value({3,4,5},"3 4 5"),
+       "numbers of particles, including Higgs")
+      ("parts", po::value<vector<char>>(&parts)->multitoken()
+       ->default_value({'B','R','V','I'},"B R V I"),
+       "BlackHat ntuple parts")
+      ("weights,w", po::value<vector<unsigned>>(&nws)->multitoken()
+       ->default_value({1,10,100},"1 10 100"),
+       "numbers of weights for histogram filling")
+      ("num-ent,n", po::value<Long64_t>(&niter)->default_value(100000),
+       "iterations per benchmark")
+      ("pool", po::value<size_t>(&npool)->default_value(1000),
+       "number of generated events cycled through")
+      ("seed", po::value<unsigned>(&seed)->default_value(0),
+       "random seed for event generation")
+    ;
+
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+    if (vm.count("help")) {
+      cout << desc << endl;
+      return 0;
+    }
+    po::notify(vm);
+  }
+  catch(exception& e) {
+    cerr << "\033[31mError: " <<  e.what() <<"\033[0m"<< endl;
+    exit(1);
+  }
+  // END OPTIONS ****************************************************
+
+  LHAPDF::setVerbosity(0);
+  TH1::AddDirectory(kFALSE);
+  bhgen gen(seed);
+
+  // Reweighting ****************************************************
+  pdf_set pdf(pdf_name);
+  if (pdf_unc) pdf.mkmembers();
+
+  const mu_fHt_Higgs mu(0.5);
+  fac_calc fac(&mu,&pdf), fac_unc(&mu,&pdf);
+  fac_unc.pdf_unc = true;
+  const ren_calc ren(&mu,&pdf);
+
+  TTree tree("weights","");
+  const reweighter rew(make_pair(&fac,"Ht2"), make_pair(&ren,"Ht2"), &tree);
+  cerr << endl;
+
+  for (char part : parts) for (Int_t np : nps) {
+    vector<BHEvent> pool(npool);
+    for (auto& e : pool) gen(e,part,np);
+
+    result("mu_calc")("part",part)("np",np).prt( niter,
+      run(pool,niter,[&]{ mu.calc(); }) );
+
+    result("fac_calc")("part",part)("np",np).prt( niter,
+      run(pool,niter,[&]{ mu.calc(); fac.calc(); }) - run(pool,niter,[&]{ mu.calc(); }) );
+
+    if (pdf_unc)
+      result("fac_calc_unc")("part",part)("np",np).prt( niter,
+        run(pool,niter,[&]{ mu.calc(); fac_unc.calc(); }) - run(pool,niter,[&]{ mu.calc(); }) );
+
+    result("ren_calc")("part",part)("np",np).prt( niter,
+      run(pool,niter,[&]{ mu.calc(); ren.calc(); }) - run(pool,niter,[&]{ mu.calc(); }) );
+
+    mu.calc(); fac.calc(); ren.calc();
+    result("stitch")("part",part)("np",np).prt( niter,
+      run(pool,niter,[&]{ rew.stitch(); }) );
+  }
+
+  // Clustering as in hist_H3j **************************************
+  const fastjet::JetDefinition jet_def(fastjet::antikt_algorithm,0.4);
+  const small_cluster clust(jet_def);
+  for (Int_t np : nps) {
+    vector<BHEvent> pool(npool);
+    for (auto& e : pool) gen(e,'R',np);
+
+    vector<fastjet::PseudoJet> particles;
+    auto set_particles = [&]{
+      particles.clear();
+      for (Int_t i=1; i<event.nparticle; ++i)
+        particles.emplace_back(
+          event.px[i],event.py[i],event.pz[i],event.E[i]
+        );
+    };
+
+    result("fastjet")("np",np).prt( niter, run(pool,niter,[&]{
+      set_particles();
+      sink += sorted_by_pt(
+        fastjet::ClusterSequence(particles, jet_def).inclusive_jets(30.)
+      ).size();
+    }) );
+
+    result("small_cluster")("np",np).prt( niter, run(pool,niter,[&]{
+      set_particles();
+      sink += sorted_by_pt( clust.inclusive_jets(particles,30.) ).size();
+    }) );
+
+    // jets must be bit-identical to FastJet's, in the same order
+    size_t nbad = 0;
+    for (const auto& e : pool) {
+      event = e;
+      set_particles();
+      const auto a = fastjet::ClusterSequence(particles, jet_def)
+                       .inclusive_jets(30.);
+      const auto b = clust.inclusive_jets(particles,30.);
+      bool same = a.size()==b.size();
+      for (size_t i=0; same && i<a.size(); ++i)
+        same = a[i].px()==b[i].px() && a[i].py()==b[i].py() &&
+               a[i].pz()==b[i].pz() && a[i].E ()==b[i].E ();
+      if (!same) ++nbad;
+    }
+    cout << "{\"check\":\"small_cluster\",\"np\":" << np
+         << ",\"events\":" << pool.size()
+         << ",\"mismatches\":" << nbad << '}' << endl;
+  }
+
+  // Histograms *****************************************************
+  hist::css.reset( new csshists(css_file) );
+
+  static const vector<string> names {
+    "H_mass", "jets_N_incl", "jets_N_excl", "H_pT_0j", "H_pT_1j_excl",
+    "H_y_2j", "H3j_pT", "H1j_pT_excl", "jet1_mass", "jet2_pT", "jet3_y",
+    "jet1_tau", "jets_HT", "jets_tau_max", "jets_tau_sum"
+  };
+  {
+    const Long64_t n = niter/100 + 1;
+    const auto start = bench_clock::now();
+    for (Long64_t i=0; i<n; ++i)
+      delete hist::css->mkhist(names[i%names.size()]);
+    result("mkhist").prt( n, chrono::duration<double,nano>(
+      bench_clock::now() - start ).count() );
+  }
+
+  // bins must be the same as TAxis::FindFixBin's, also at the edges
+  {
+    vector<TAxis> axes;
+    for (const auto& name : names) {
+      unique_ptr<TH1> h( hist::css->mkhist(name) );
+      axes.push_back(*h->GetXaxis());
+    }
+    axes.emplace_back(50,-4.5,4.5);
+    axes.emplace_back(10,0.,100.);
+
+    mt19937 rng(seed);
+    for (const auto& axis : axes) {
+      const fast_axis fast(&axis);
+      const Double_t lo = axis.GetXmin(), hi = axis.GetXmax();
+      vector<Double_t> xs;
+      for (Int_t b=1, n=axis.GetNbins(); b<=n+1; ++b) {
+        const Double_t e = axis.GetBinLowEdge(b);
+        xs.insert(xs.end(), {
+          nextafter(e,-INFINITY), e, nextafter(e,INFINITY) });
+      }
+      uniform_real_distribution<Double_t> dist(
+        lo - (hi-lo)/10, hi + (hi-lo)/10);
+      for (size_t i=0; i<npool; ++i) xs.push_back(dist(rng));
+      xs.push_back(NAN);
+
+      size_t nbad = 0;
+      for (Double_t x : xs)
+        if (fast.find(x)!=axis.FindFixBin(x)) ++nbad;
+      cout << "{\"check\":\"fast_axis\",\"nbins\":" << axis.GetNbins()
+           << ",\"xmin\":" << lo << ",\"xmax\":" << hi
+           << ",\"variable\":"
+           << (axis.GetXbins()->GetSize() ? "true" : "false")
+           << ",\"points\":" << xs.size()
+           << ",\"mismatches\":" << nbad << '}' << endl;
+    }
+  }
+
+  TMemFile fout("bench.root","recreate");
+  for (unsigned nw : nws) {
+    weight::all.clear();
+    hist::dirs.clear();
+
+    // weights are read from a tree the same way as in hist programs
+    TTree wt_tree("weights","");
+    vector<Float_t> w(nw,1.);
+    for (unsigned i=0; i<nw; ++i) {
+      const string name = "w"+to_string(i);
+      wt_tree.Branch(name.c_str(), &w[i], (name+"/F").c_str());
+    }
+    wt_tree.Fill();
+    for (unsigned i=0; i<nw; ++i) {
+      const string name = "w"+to_string(i);
+      weight::add(&wt_tree,name);
+      hist::dirs[weight::all.back().get()] = fout.mkdir(name.c_str());
+    }
+    wt_tree.GetEntry(0);
+
+    vector<BHEvent> pool(npool);
+    for (auto& e : pool) gen(e,'B',3);
+
+    hist h("H_pT_0j");
+    result("hist_fill")("weights",nw).prt( niter, run(pool,niter,[&]{
+      h.Fill(sqrt(event.px[0]*event.px[0] + event.py[0]*event.py[0]));
+    }) );
+  }
+
+  cerr << "sink: " << sink << endl;
+
+  return 0;
+}
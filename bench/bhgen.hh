@@ -0,0 +1,77 @@
+#ifndef bhgen_hh
+#define bhgen_hh
+
+#include <cmath>
+#include <random>
+
+#include "BHEvent.hh"
+
+// Synthetic BlackHat ntuple entries ********************************
+// Kinematics and weights are random but within physical ranges,
+// so that reweighting and clustering follow the same code paths
+// as for real ntuples. Higgs is always the first particle.
+
+class bhgen {
+  std::mt19937 gen;
+  std::uniform_real_distribution<double> uni;
+  std::exponential_distribution<double> pt_tail;
+  std::normal_distribution<double> norm;
+  Int_t eid, group;
+
+  Int_t parton() noexcept {
+    const int i = uni(gen)*11.;
+    return ( i==10 ? 21 : (i<5 ? i+1 : 4-i) );
+  }
+
+public:
+  bhgen(unsigned seed=0)
+  : gen(seed), uni(0.,1.), pt_tail(1./60.), norm(0.,1.), eid(0), group(0)
+  { }
+
+  // Make an entry of the given part type with np particles
+  void operator()(BHEvent& event, Char_t part, Int_t np) noexcept {
+    // real entries share eid with their counter-events
+    if (part!='R' || group==0) {
+      ++eid;
+      if (part=='R') group = np;
+    }
+    if (group) --group;
+
+    event.eid = eid;
+    event.nparticle = np;
+    for (Int_t i=0;i<np;++i) {
+      const bool higgs = (i==0);
+      const double pt  = pt_tail(gen) + (higgs ? 0. : 20.);
+      const double eta = (uni(gen)-0.5)*8.;
+      const double phi = uni(gen)*2.*M_PI;
+      const double m   = (higgs ? 125. : 0.);
+      event.px[i] = pt*cos(phi);
+      event.py[i] = pt*sin(phi);
+      event.pz[i] = pt*sinh(eta);
+      event.E [i] = sqrt(m*m + pt*pt*cosh(eta)*cosh(eta));
+      event.kf[i] = (higgs ? 25 : parton());
+    }
+
+    for (short i=0;i<2;++i) {
+      event.x [i] = exp( log(1e-4)*uni(gen) ) * 0.5;
+      event.xp[i] = event.x[i] + (1.-event.x[i])*uni(gen);
+      event.id[i] = parton();
+    }
+
+    event.alphas = 0.118;
+    event.alphas_power = np+1 + (part=='V' || part=='I' ? 1 : 0);
+    event.part[0] = part;
+
+    event.fac_scale = event.ren_scale = 0.5*event.Ht_Higgs();
+
+    event.me_wgt  = norm(gen);
+    event.me_wgt2 = norm(gen);
+    event.weight  = event.me_wgt2*1e3;
+    event.weight2 = event.weight;
+
+    event.nuwgt = (part=='V' || part=='I' ? 18 : 0);
+    for (Int_t i=0;i<18;++i) event.usr_wgts[i] = norm(gen);
+  }
+};
+
+#endif
@@ -4,81 +4,83 @@
 
 #include <TTree.h>
 
-void BHEvent::SetTree(TTree* tree, select_t branches, bool old) {
+#include "branches.hh"
+
+void BHEvent::SetTree(TTree* tree, select_t sel, bool old) {
   this->tree = tree;
 
-  switch (branches) {
+  switch (sel) {
     case kinematics: {
 
-      tree->SetBranchAddress("id", &eid);
-      tree->SetBranchAddress("nparticle", &nparticle);
-      tree->SetBranchAddress("px", px);
-      tree->SetBranchAddress("py", py);
-      tree->SetBranchAddress("pz", pz);
-      tree->SetBranchAddress("E" , E );
-      tree->SetBranchAddress("kf", kf);
+      branches::use(tree, "id", &eid);
+      branches::use(tree, "nparticle", &nparticle);
+      branches::use(tree, "px", px);
+      branches::use(tree, "py", py);
+      branches::use(tree, "pz", pz);
+      branches::use(tree, "E", E);
+      branches::use(tree, "kf", kf);
 
     } break;
     case reweighting: {
 
-      tree->SetBranchAddress("nparticle", &nparticle);
-      tree->SetBranchAddress("px", px);
-      tree->SetBranchAddress("py", py);
-      // tree->SetBranchAddress("pz", pz);
-      // tree->SetBranchAddress("E" , E );
-      tree->SetBranchAddress("kf", kf);
-      tree->SetBranchAddress("alphas", &alphas);
-      tree->SetBranchAddress("weight2", &weight2);
-      tree->SetBranchAddress("me_wgt", &me_wgt);
-      tree->SetBranchAddress("me_wgt2", &me_wgt2);
-      tree->SetBranchAddress("x1", &x[0]);
-      tree->SetBranchAddress("x2", &x[1]);
-      tree->SetBranchAddress("x1p", &xp[0]);
-      tree->SetBranchAddress("x2p", &xp[1]);
-      tree->SetBranchAddress("id1", &id[0]);
-      tree->SetBranchAddress("id2", &id[1]);
-      tree->SetBranchAddress("fac_scale", &fac_scale);
-      tree->SetBranchAddress("ren_scale", &ren_scale);
-      tree->SetBranchAddress("usr_wgts", usr_wgts);
+      branches::use(tree, "nparticle", &nparticle);
+      branches::use(tree, "px", px);
+      branches::use(tree, "py", py);
+      // branches::use(tree, "pz", pz);
+      // branches::use(tree, "E", E);
+      branches::use(tree, "kf", kf);
+      branches::use(tree, "alphas", &alphas);
+      branches::use(tree, "weight2", &weight2);
+      branches::use(tree, "me_wgt", &me_wgt);
+      branches::use(tree, "me_wgt2", &me_wgt2);
+      branches::use(tree, "x1", &x[0]);
+      branches::use(tree, "x2", &x[1]);
+      branches::use(tree, "x1p", &xp[0]);
+      branches::use(tree, "x2p", &xp[1]);
+      branches::use(tree, "id1", &id[0]);
+      branches::use(tree, "id2", &id[1]);
+      branches::use(tree, "fac_scale", &fac_scale);
+      branches::use(tree, "ren_scale", &ren_scale);
+      branches::use(tree, "usr_wgts", usr_wgts);
       if (!old) {
-        tree->SetBranchAddress("alphasPower", &alphas_power);
-        tree->SetBranchAddress("part", part);
+        branches::use(tree, "alphasPower", &alphas_power);
+        branches::use(tree, "part", part);
       }
 
     } break;
     case cross_section: {
 
-      // tree->SetBranchAddress("nparticle", &nparticle);
-      // tree->SetBranchAddress("kf", kf);
-      tree->SetBranchAddress("weight", &weight);
+      // branches::use(tree, "nparticle", &nparticle);
+      // branches::use(tree, "kf", kf);
+      branches::use(tree, "weight", &weight);
 
     } break;
     default: {
 
-      tree->SetBranchAddress("id", &eid);
-      tree->SetBranchAddress("nparticle", &nparticle);
-      tree->SetBranchAddress("px", px);
-      tree->SetBranchAddress("py", py);
-      tree->SetBranchAddress("pz", pz);
-      tree->SetBranchAddress("E", E);
-      tree->SetBranchAddress("alphas", &alphas);
-      tree->SetBranchAddress("kf", kf);
-      tree->SetBranchAddress("weight", &weight);
-      tree->SetBranchAddress("weight2", &weight2);
-      tree->SetBranchAddress("me_wgt", &me_wgt);
-      tree->SetBranchAddress("me_wgt2", &me_wgt2);
-      tree->SetBranchAddress("x1", &x[0]);
-      tree->SetBranchAddress("x2", &x[1]);
-      tree->SetBranchAddress("x1p", &xp[0]);
-      tree->SetBranchAddress("x2p", &xp[1]);
-      tree->SetBranchAddress("id1", &id[0]);
-      tree->SetBranchAddress("id2", &id[1]);
-      tree->SetBranchAddress("fac_scale", &fac_scale);
-      tree->SetBranchAddress("ren_scale", &ren_scale);
-      tree->SetBranchAddress("nuwgt", &nuwgt);
-      tree->SetBranchAddress("usr_wgts", usr_wgts);
-      tree->SetBranchAddress("alphasPower", &alphas_power);
-      tree->SetBranchAddress("part", part);
+      branches::use(tree, "id", &eid);
+      branches::use(tree, "nparticle", &nparticle);
+      branches::use(tree, "px", px);
+      branches::use(tree, "py", py);
+      branches::use(tree, "pz", pz);
+      branches::use(tree, "E", E);
+      branches::use(tree, "alphas", &alphas);
+      branches::use(tree, "kf", kf);
+      branches::use(tree, "weight", &weight);
+      branches::use(tree, "weight2", &weight2);
+      branches::use(tree, "me_wgt", &me_wgt);
+      branches::use(tree, "me_wgt2", &me_wgt2);
+      branches::use(tree, "x1", &x[0]);
+      branches::use(tree, "x2", &x[1]);
+      branches::use(tree, "x1p", &xp[0]);
+      branches::use(tree, "x2p", &xp[1]);
+      branches::use(tree, "id1", &id[0]);
+      branches::use(tree, "id2", &id[1]);
+      branches::use(tree, "fac_scale", &fac_scale);
+      branches::use(tree, "ren_scale", &ren_scale);
+      branches::use(tree, "nuwgt", &nuwgt);
+      branches::use(tree, "usr_wgts", usr_wgts);
+      branches::use(tree, "alphasPower", &alphas_power);
+      branches::use(tree, "part", part);
 
     }
   }
@@ -2,27 +2,52 @@
 
 #include <cmath>
 #include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <algorithm>
 
 #include "TTree.h"
+#include "TBranch.h"
+
+#include "branches.hh"
 
 using namespace std;
 
 #define branch(var) \
-  if ( tree->SetBranchAddress((name+'_'+#var).c_str(), &var) \
+  if ( branches::use(tree, name+'_'+#var, &var) \
+       == TTree::kMissingBranch ) exit(1);
+#define flat_branch(var) \
+  if ( branches::use(tree, name+'_'+#var, flat_##var) \
        == TTree::kMissingBranch ) exit(1);
 
 SJClusterAlg::SJClusterAlg(TTree* tree, const string& name)
 : N(0), eta(0), phi(0), e(0), mass(0), pt(0), numC(0), ind(0),
   name(name)
 {
+  // vectors are stored in element branches, flat arrays in plain ones
+  const TBranch *b = tree->GetBranch((name+"_pt").c_str());
+  if (!b) {
+    cerr << "\033[31mNo branch " << name << "_pt in "
+         << tree->GetName() << "\033[0m" << endl;
+    exit(1);
+  }
+  flat = !strlen(b->GetClassName());
+
   branch(N)
-  branch(eta)
-  branch(phi)
-  //branch(e)
-  branch(mass)
-  branch(pt)
-  //branch(ind)
-  //branch(numC)
+  if (flat) {
+    flat_branch(eta)
+    flat_branch(phi)
+    flat_branch(mass)
+    flat_branch(pt)
+  } else {
+    branch(eta)
+    branch(phi)
+    //branch(e)
+    branch(mass)
+    branch(pt)
+    //branch(ind)
+    //branch(numC)
+  }
 }
 SJClusterAlg::~SJClusterAlg() { }
 
@@ -32,33 +57,58 @@ void SJClusterAlg::add(TTree* tree, const string& name) noexcept {
   all.emplace_back( new SJClusterAlg(tree,name) );
 }
 
-class sortByPt { // class used for jet sorting
-  const SJClusterAlg *p;
-  public:
-  sortByPt(const SJClusterAlg* p) noexcept: p(p) { }
-  bool operator() (Int_t i, Int_t j) const noexcept {
-    return ( p->pt->operator[](i) > p->pt->operator[](j) ); // decending order
-  }
-};
+void SJClusterAlg::jetsByPt(SJjets& jets, double pt_cut, double eta_cut,
+                            size_t k) const {
+  const Float_t
+    *_pt   = (flat ? flat_pt   : pt->data()),
+    *_eta  = (flat ? flat_eta  : eta->data()),
+    *_phi  = (flat ? flat_phi  : phi->data()),
+    *_mass = (flat ? flat_mass : mass->data());
 
-vector<TLorentzVector> SJClusterAlg::jetsByPt(double pt_cut, double eta_cut) const {
-  Int_t j[N]; // order of jets
-  for (Int_t i=0;i<N;++i) j[i] = i;
-  sort(j,j+N,sortByPt(this));
+  // cuts first
+  sel.clear();
+  bool sorted = true;
+  for (Int_t i=0;i<N;++i)
+    if (_pt[i] >= pt_cut && abs(_eta[i]) <= eta_cut) {
+      if (sel.size()) sorted &= (_pt[i] <= _pt[sel.back()]);
+      sel.push_back(i);
+    }
 
-  vector<TLorentzVector> jets;
-  jets.reserve(N);
-  for (Int_t i=0;i<N;++i) {
-    const double _pt  = pt->at(j[i]);
-    const double _eta = eta->at(j[i]);
+  // order only the jets that are used,
+  // unless sj_flatten has already sorted them
+  const size_t n = sel.size();
+  if (k > n) k = n;
+  if (!sorted) partial_sort(sel.begin(), sel.begin()+k, sel.end(),
+    [_pt](Int_t i, Int_t j){ return _pt[i] > _pt[j]; } // decending order
+  );
 
-    // cuts
-    if (_pt  < pt_cut ) continue;
-    if ( abs(_eta) > eta_cut) continue;
+  jets.pt  .resize(n);
+  jets.eta .resize(n);
+  jets.phi .resize(n);
+  jets.mass.resize(n);
+  jets.y   .resize(n);
+  jets.px  .resize(n);
+  jets.py  .resize(n);
+  jets.pz  .resize(n);
+  jets.E   .resize(n);
 
-    jets.emplace_back();
-    jets.back().SetPtEtaPhiM(_pt,_eta,phi->at(j[i]),mass->at(j[i]));
+  for (size_t i=0;i<n;++i) {
+    const Int_t j = sel[i];
+    jets.pt  [i] = _pt[j];
+    jets.eta [i] = _eta[j];
+    jets.phi [i] = _phi[j];
+    jets.mass[i] = _mass[j];
   }
 
-  return jets;
+  // kinematics as in TLorentzVector::SetPtEtaPhiM, array at a time
+  for (size_t i=0;i<n;++i) {
+    jets.px[i] = jets.pt[i]*cos(jets.phi[i]);
+    jets.py[i] = jets.pt[i]*sin(jets.phi[i]);
+    jets.pz[i] = jets.pt[i]*sinh(jets.eta[i]);
+  }
+  for (size_t i=0;i<n;++i) {
+    const Double_t m = jets.mass[i], p = jets.pt[i]*cosh(jets.eta[i]);
+    jets.E[i] = sqrt(max(p*p + m*abs(m), 0.));
+  }
+  rapidities(n, jets.E.data(), jets.pz.data(), jets.y.data());
 }
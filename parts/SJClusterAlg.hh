@@ -5,10 +5,24 @@
 #include <vector>
 #include <memory>
 
-#include "TLorentzVector.h"
+#include <Rtypes.h>
+
+#include "vec4.hh"
+
+#define SJMAXNJ 100 // maximum number of jets in flat SpartyJet trees
 
 class TTree;
 
+// Jets passing cuts, as a structure of arrays **********************
+// The first k jets are ordered by decreasing pT, the rest are not
+struct SJjets {
+  std::vector<Double_t> pt, eta, phi, mass, y, px, py, pz, E;
+  size_t size() const noexcept { return pt.size(); }
+  vec4 operator[](size_t i) const noexcept {
+    return vec4(px[i],py[i],pz[i],E[i],pt[i],y[i],phi[i],mass[i]);
+  }
+};
+
 struct SJClusterAlg {
   Int_t N;
   std::vector<Float_t> *eta, *phi, *e, *mass, *pt, *numC;
@@ -19,15 +33,27 @@ struct SJClusterAlg {
   // For some ROOT hocus-pocus reason, these pointers have
   // to be initialized to zero
 
+  // Count-plus-array branches written by sj_flatten
+  // are read instead of the vectors, if the tree has them
+  bool flat;
+  Float_t flat_eta[SJMAXNJ], flat_phi[SJMAXNJ],
+          flat_mass[SJMAXNJ], flat_pt[SJMAXNJ];
+
   const std::string name;
 
-  std::vector<TLorentzVector> jetsByPt(double pt_cut, double eta_cut) const;
+  // Select jets with pt >= pt_cut and |eta| <= eta_cut,
+  // sort only the k leading ones, and compute their kinematics
+  void jetsByPt(SJjets& jets, double pt_cut, double eta_cut,
+                size_t k=-1) const;
 
   SJClusterAlg(TTree* tree, const std::string& name);
   ~SJClusterAlg();
 
   static std::vector<std::unique_ptr<const SJClusterAlg>> all;
   static void add(TTree* tree, const std::string& name) noexcept;
+
+private:
+  mutable std::vector<Int_t> sel; // indices of selected jets
 };
 
 #endif
@@ -0,0 +1,70 @@
+#include "branches.hh"
+
+#include <iostream>
+#include <iomanip>
+
+#include <TBranch.h>
+#include <TFriendElement.h>
+#include <TList.h>
+#include <TObjArray.h>
+
+using namespace std;
+
+void branches::use(TTree* tree, const string& name) {
+  used[tree].push_back(name);
+}
+
+branches::stats branches::prune(TTree* tree) {
+  tree->LoadTree(0); // a chain and its friends load their first trees
+
+  vector<TTree*> trees { tree };
+  if (TList *friends = tree->GetListOfFriends()) {
+    TIter next(friends);
+    while (TFriendElement *fe = (TFriendElement*)next())
+      if (TTree *t = fe->GetTree()) trees.push_back(t);
+  }
+
+  // A chain keeps branch statuses and sets them for every file it loads
+  const vector<string>& names = used[tree];
+  for (TTree *t : trees) {
+    t->SetBranchStatus("*",0);
+    for (const auto& name : names)
+      if (t->GetListOfBranches()->FindObject(name.c_str()))
+        t->SetBranchStatus(name.c_str(),1);
+  }
+
+  stats s;
+  s.entries = tree->GetTree()->GetEntries();
+  for (TTree *t : trees) {
+    TObjArray *br = t->GetTree()->GetListOfBranches();
+    for (Int_t i=0,n=br->GetEntries();i<n;++i) {
+      TBranch *b = static_cast<TBranch*>(br->At(i));
+      const Long64_t zip = b->GetZipBytes("*"), tot = b->GetTotBytes("*");
+      ++s.nall;
+      s.zip_all += zip;
+      s.tot_all += tot;
+      if (!b->TestBit(kDoNotProcess)) {
+        ++s.nread;
+        s.zip_read += zip;
+        s.tot_read += tot;
+      }
+    }
+  }
+  return s;
+}
+
+unordered_map<const TTree*,vector<string>> branches::used;
+
+ostream& operator<<(ostream& os, const branches::stats& s) {
+  const Long64_t n = (s.entries ? s.entries : 1);
+  const auto flags = os.flags();
+  os << "Reading " << s.nread << " of " << s.nall << " branches: "
+     << s.zip_read/n << " of " << s.zip_all/n << " compressed and "
+     << s.tot_read/n << " of " << s.tot_all/n
+     << " uncompressed bytes per entry";
+  if (s.zip_all)
+    os << " (" << fixed << setprecision(0)
+       << 100.*(s.zip_all-s.zip_read)/s.zip_all << "% skipped)";
+  os.flags(flags);
+  return os;
+}
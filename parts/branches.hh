@@ -0,0 +1,47 @@
+#ifndef branches_hh
+#define branches_hh
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <iosfwd>
+
+#include <TTree.h>
+
+// Branch pruning ***************************************************
+// Classes reading a tree register the branches they use. prune() then
+// disables all other branches of the tree and of its friends, so that
+// GetEntry only reads and decompresses the registered ones.
+
+class branches {
+  static std::unordered_map<const TTree*,std::vector<std::string>> used;
+
+public:
+  // Set address and register a branch of the tree or its friends
+  template<typename T>
+  static Int_t use(TTree* tree, const std::string& name, T* addr) {
+    const Int_t ret = tree->SetBranchAddress(name.c_str(), addr);
+    if (ret != TTree::kMissingBranch) use(tree,name);
+    return ret;
+  }
+  static void use(TTree* tree, const std::string& name);
+
+  // Registered branches of the tree and its friends
+  static const std::vector<std::string>& of(const TTree* tree) {
+    return used[tree];
+  }
+
+  // Sizes of branches of the current file, read or all of them
+  struct stats {
+    Int_t nread = 0, nall = 0;
+    Long64_t zip_read = 0, zip_all = 0, tot_read = 0, tot_all = 0;
+    Long64_t entries = 0;
+  };
+
+  // Disable unregistered branches, after all branches are registered
+  static stats prune(TTree* tree);
+};
+
+std::ostream& operator<<(std::ostream& os, const branches::stats& s);
+
+#endif
@@ -0,0 +1,163 @@
+#include "eid_index.hh"
+
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+
+#include <TFile.h>
+#include <TTree.h>
+#include <TChain.h>
+#include <TBranch.h>
+#include <TObjArray.h>
+#include <TParameter.h>
+
+using namespace std;
+
+// file.eid: magic, number of entries, number of groups,
+// then the first entry and eid of every group
+static const char eid_magic[4] = {'e','i','d','1'};
+
+eid_index::eid_index(TChain* chain, const char* branch, bool saved)
+: nent(0), has_id(true)
+{
+  const TObjArray *files = chain->GetListOfFiles();
+  for (Int_t i=0,n=files->GetEntries();i<n;++i) {
+    const char *file = files->At(i)->GetTitle();
+    TFile *f = TFile::Open(file,"read");
+    if (!f || f->IsZombie()) exit(1);
+    TTree *tree = (TTree*)f->Get(chain->GetName());
+    if (!tree) {
+      cerr << "\033[31mNo tree " << chain->GetName() << " in "
+           << file << "\033[0m" << endl;
+      exit(1);
+    }
+    const Long64_t file_nent = tree->GetEntries();
+
+    if (saved && read_saved(string(file)+".eid", file_nent)) {
+      nent += file_nent;
+      delete f;
+      continue;
+    }
+
+    // only the id branch is read
+    TBranch *b = tree->GetBranch(branch);
+    if (!b) {
+      has_id = false;
+      groups.clear();
+      delete f;
+      return;
+    }
+    Int_t eid;
+    b->SetAddress(&eid);
+    for (Long64_t ent=0; ent<file_nent; ++ent) {
+      b->GetEntry(ent);
+      append(nent+ent,eid);
+    }
+    nent += file_nent;
+    delete f;
+  }
+}
+
+void eid_index::append(Long64_t first, Int_t eid) {
+  // a group may continue into the next file
+  if (groups.empty() || groups.back().second!=eid)
+    groups.emplace_back(first,eid);
+}
+
+bool eid_index::read_saved(const string& file, Long64_t file_nent) {
+  ifstream f(file, ios::binary);
+  if (!f) return false;
+
+  char magic[4];
+  Long64_t n, ng;
+  f.read(magic,4);
+  f.read(reinterpret_cast<char*>(&n),sizeof(n));
+  f.read(reinterpret_cast<char*>(&ng),sizeof(ng));
+  if (!f || !equal(magic,magic+4,eid_magic) || n!=file_nent) {
+    cerr << "\033[33mIgnoring outdated index " << file << "\033[0m" << endl;
+    return false;
+  }
+
+  vector<pair<Long64_t,Int_t>> g(ng);
+  for (auto& x : g) {
+    f.read(reinterpret_cast<char*>(&x.first),sizeof(x.first));
+    f.read(reinterpret_cast<char*>(&x.second),sizeof(x.second));
+  }
+  if (!f) {
+    cerr << "\033[33mIgnoring truncated index " << file << "\033[0m" << endl;
+    return false;
+  }
+  for (const auto& x : g) append(nent+x.first,x.second);
+  return true;
+}
+
+void eid_index::write(const string& file) const {
+  ofstream f(file, ios::binary);
+  if (!f) {
+    cerr << "\033[31mCannot write " << file << "\033[0m" << endl;
+    exit(1);
+  }
+  const Long64_t ng = groups.size();
+  f.write(eid_magic,4);
+  f.write(reinterpret_cast<const char*>(&nent),sizeof(nent));
+  f.write(reinterpret_cast<const char*>(&ng),sizeof(ng));
+  for (const auto& x : groups) {
+    f.write(reinterpret_cast<const char*>(&x.first),sizeof(x.first));
+    f.write(reinterpret_cast<const char*>(&x.second),sizeof(x.second));
+  }
+}
+
+Long64_t eid_index::mismatch(const eid_index& other) const noexcept {
+  const size_t n = min(groups.size(),other.groups.size());
+  for (size_t i=0;i<n;++i)
+    if (groups[i]!=other.groups[i])
+      return min(groups[i].first,other.groups[i].first);
+  if (groups.size()>n) return groups[n].first;
+  if (other.groups.size()>n) return other.groups[n].first;
+  if (nent!=other.nent) return min(nent,other.nent);
+  return -1;
+}
+
+Long64_t eid_index::snap(Long64_t ent) const noexcept {
+  const auto it = lower_bound(groups.begin(), groups.end(), ent,
+    [](const pair<Long64_t,Int_t>& g, Long64_t e){ return g.first < e; });
+  return (it==groups.end() ? nent : it->first);
+}
+
+pair<Long64_t,Long64_t> eid_index::shard(unsigned i, unsigned n,
+  Long64_t first, Long64_t end) const noexcept
+{
+  if (end < 0) end = nent;
+  const Long64_t len = end - first;
+  return { snap(first + len*i/n), snap(first + len*(i+1)/n) };
+}
+
+Long64_t dropped_events(TFile* file) {
+  const auto *n = dynamic_cast<TParameter<Long64_t>*>(
+    file->Get("dropped_events"));
+  return (n ? n->GetVal() : 0);
+}
+
+Long64_t dropped_events(TChain* chain, Long64_t first, Long64_t end) {
+  Long64_t n = 0, offset = 0, at_end = 0;
+  const TObjArray *files = chain->GetListOfFiles();
+  for (Int_t i=0,nf=files->GetEntries();i<nf;++i) {
+    const char *file = files->At(i)->GetTitle();
+    TFile *f = TFile::Open(file,"read");
+    if (!f || f->IsZombie()) exit(1);
+    TTree *tree = (TTree*)f->Get(chain->GetName());
+    if (!tree) {
+      cerr << "\033[31mNo tree " << chain->GetName() << " in "
+           << file << "\033[0m" << endl;
+      exit(1);
+    }
+    const Long64_t file_nent = tree->GetEntries();
+    if (offset >= first && (end < 0 || offset < end)) n += dropped_events(f);
+    else if (offset == end && !file_nent) at_end += dropped_events(f);
+    else at_end = 0;
+    offset += file_nent;
+    delete f;
+  }
+  // empty files after the last entry are in the last range
+  return (offset == end ? n + at_end : n);
+}
@@ -0,0 +1,67 @@
+#ifndef eid_index_hh
+#define eid_index_hh
+
+#include <string>
+#include <vector>
+#include <utility>
+
+#include <Rtypes.h>
+
+class TChain;
+class TFile;
+class TFile;
+
+// Event id index ***************************************************
+// First entry of every group of consecutive entries with the same eid,
+// with that eid, read from the id branch of each file of a chain.
+// Inputs are aligned if their indices are equal. Entries of a group
+// are one event, so ranges of entries are split only between groups.
+//
+// The index of a file is read from file.eid, written by index_eid,
+// if it is there and has the file's number of entries. Otherwise
+// only the id branch of the file is scanned.
+
+class eid_index {
+  std::vector<std::pair<Long64_t,Int_t>> groups;
+  Long64_t nent;
+  bool has_id;
+
+  void append(Long64_t first, Int_t eid);
+  bool read_saved(const std::string& file, Long64_t file_nent);
+
+public:
+  eid_index(TChain* chain, const char* branch="id", bool saved=true);
+
+  // false if the chain has no id branch
+  explicit operator bool() const noexcept { return has_id; }
+
+  // first entry where the event ids differ, or -1
+  Long64_t mismatch(const eid_index& other) const noexcept;
+
+  // number of groups, and the first entry of group i
+  size_t size() const noexcept { return groups.size(); }
+  Long64_t operator[](size_t i) const noexcept { return groups[i].first; }
+  Long64_t entries() const noexcept { return nent; }
+
+  // first entry of the first group starting at or after ent
+  Long64_t snap(Long64_t ent) const noexcept;
+
+  // entries [first,end) of shard i of n of the range, with about
+  // equal entries; a group is in the shard where it starts
+  std::pair<Long64_t,Long64_t> shard(unsigned i, unsigned n,
+    Long64_t first=0, Long64_t end=-1) const noexcept;
+
+  // save the index of a chain of one file
+  void write(const std::string& file) const;
+};
+
+// Events dropped by skim_bh ****************************************
+// A skimmed file keeps the number of events of its inputs that have
+// no entries in it, so that they are still counted. Those of a chain
+// are counted for the files that start in the range [first,end),
+// and for empty files at the end of the chain if the range ends there.
+
+Long64_t dropped_events(TFile* file);
+Long64_t dropped_events(TChain* chain, Long64_t first=0, Long64_t end=-1);
+
+#endif
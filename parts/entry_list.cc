@@ -0,0 +1,68 @@
+#include "entry_list.hh"
+
+#include <iostream>
+#include <cstring>
+
+#include <TFile.h>
+#include <TKey.h>
+#include <TList.h>
+#include <TTree.h>
+#include <TChain.h>
+#include <TObjArray.h>
+#include <TEntryList.h>
+
+using namespace std;
+
+TEntryList* read_entry_list(const string& file) {
+  TFile *f = new TFile(file.c_str(),"read");
+  if (f->IsZombie()) exit(1);
+
+  TEntryList *list = nullptr;
+  TIter nextkey(f->GetListOfKeys());
+  while (TKey *key = (TKey*)nextkey()) {
+    if (strcmp(key->GetClassName(),"TEntryList")) continue;
+    list = static_cast<TEntryList*>(key->ReadObj());
+    break;
+  }
+  if (!list) {
+    cerr << "\033[31mNo entry list in " << file << "\033[0m" << endl;
+    exit(1);
+  }
+  list->SetDirectory(nullptr); // outlives the file
+
+  delete f;
+  return list;
+}
+
+TEntryList* entry_sublist(TEntryList* list,
+                          const char* tree, const char* file) {
+  TEntryList *sub = list->GetEntryList(tree,file);
+  if (!sub) {
+    cerr << "\033[31mNo entries of " << file << " in entry list "
+         << list->GetName() << "\033[0m" << endl;
+    exit(1);
+  }
+  return sub;
+}
+
+void set_entry_list(TChain* chain, TEntryList* list) {
+  const TObjArray *files = chain->GetListOfFiles();
+  for (Int_t i=0,n=files->GetEntries();i<n;++i)
+    entry_sublist(list, chain->GetName(), files->At(i)->GetTitle());
+  chain->SetEntryList(list);
+}
+
+void write_entry_list(TEntryList* list, const string& file) {
+  list->OptimizeStorage(); // bitmaps for dense blocks
+  TFile *f = new TFile(file.c_str(),"recreate");
+  if (f->IsZombie()) exit(1);
+  list->Write();
+  f->Close();
+  delete f;
+}
+
+entry_loop::entry_loop(TTree* tree, Long64_t first, Long64_t end)
+: tree(tree), first(first), end(end), i(first), all(!tree->GetEntryList())
+{
+  if (!all) i = 0;
+}
@@ -0,0 +1,53 @@
+#ifndef entry_list_hh
+#define entry_list_hh
+
+#include <string>
+
+#include <TTree.h>
+
+class TChain;
+class TEntryList;
+
+// Entry lists ******************************************************
+// Entries passing a selection are saved as a TEntryList, with a
+// sublist per input file. ROOT stores dense blocks as bitmaps.
+// Files must be given the same way when the list is read back.
+
+// The first entry list in the file
+TEntryList* read_entry_list(const std::string& file);
+
+// Sublist of the file, exits if there is none
+TEntryList* entry_sublist(TEntryList* list,
+                          const char* tree, const char* file);
+
+// Checks that every file of the chain has a sublist,
+// and sets the list on the chain
+void set_entry_list(TChain* chain, TEntryList* list);
+
+void write_entry_list(TEntryList* list, const std::string& file);
+
+// Entries to read **************************************************
+// All entries from first to end, or only those of the entry list
+// of the tree in that range
+
+class entry_loop {
+  TTree *tree;
+  const Long64_t first, end;
+  Long64_t i;
+  const bool all;
+
+public:
+  entry_loop(TTree* tree, Long64_t first, Long64_t end);
+
+  // next entry, or -1 after the last one
+  Long64_t next() {
+    if (all) return (i < end ? i++ : -1);
+    for (Long64_t ent; ; ) {
+      ent = tree->GetEntryNumber(i++);
+      if (ent < 0 || ent >= end) return -1;
+      if (ent >= first) return ent;
+    }
+  }
+};
+
+#endif
@@ -0,0 +1,253 @@
+#include "hist.hh"
+
+#include <sstream>
+#include <algorithm>
+#include <stdexcept>
+
+#include <TAxis.h>
+#include <TArrayD.h>
+#include <TDirectory.h>
+#include <TProfile.h>
+
+using namespace std;
+
+// Axis accelerator *************************************************
+
+fast_axis::fast_axis(const TAxis* axis)
+: lo(axis->GetXmin()), hi(axis->GetXmax()), len(hi-lo), inv(0.),
+  n(axis->GetNbins())
+{
+  const TArrayD* xbins = axis->GetXbins();
+  if (xbins->GetSize()) {
+    edges.assign(xbins->GetArray(),xbins->GetArray()+n+1);
+    // a few table cells per bin keep the scan to about one step
+    const Int_t m = 4*n;
+    inv = m/(hi-lo);
+    // lut[k] is the lowest bin containing any x with Int_t((x-lo)*inv)==k,
+    // found with the same expression as in find(), so rounding is safe
+    lut.resize(m+1);
+    Int_t b = 1;
+    for (Int_t k=0;k<=m;++k) {
+      while (b<n && Int_t((edges[b]-lo)*inv) < k) ++b;
+      lut[k] = b;
+    }
+  }
+}
+
+// Histograms in contiguous storage *********************************
+
+hist_block::hist_block(const string& name)
+: name(name), proto(hist::css->mkhist(name)),
+  is2d(proto->GetDimension()==2), isprof(dynamic_cast<TProfile*>(proto)),
+  grouped(group_events && !isprof), // profiles are not errors of sums
+  xaxis(proto->GetXaxis()), yaxis(proto->GetYaxis()),
+  in(hist::css->slices(name))
+{
+  proto->SetDirectory(nullptr);
+
+  nx2 = xaxis.nbins()+2;
+  ncells = is2d ? nx2*(yaxis.nbins()+2) : nx2;
+  nval = isprof ? 4 : 1; // sum w, w*y, w*y^2, w^2 for profiles
+  // sum w, w^2, w*x, w*x^2 for the statistics of plain 1D histograms
+  nstat = (is2d || isprof) ? 0 : 4;
+
+  if (size_t(count(name.begin(),name.end(),'%'))!=in.size())
+    throw runtime_error(
+      "histogram \""+name+"\" needs a % for every BinnedIn variable"
+    );
+
+  nslices = 1;
+  stride.reserve(in.size());
+  for (const auto& b : in) {
+    stride.push_back(nslices);
+    nslices *= (b.above ? b.edges.size() : b.edges.size()-1);
+  }
+  lo.resize(in.size());
+  hi.resize(in.size());
+  idx.resize(in.size());
+
+  // bins, statistics, sums of squares, then event buffer if grouped
+  // profiles keep the sums of squares of weights with their bins
+  w2 = nslices*(ncells*nval+nstat);
+  ev = w2 + (isprof ? 0 : nslices*ncells);
+  const size_t size = ev + (grouped ? nslices*ncells : 0);
+  if (grouped) touched.assign(nslices*ncells,0);
+
+  bufs.reserve(weight::all.size());
+  for (auto& wt : weight::all)
+    bufs.emplace_back(wt.get(),vector<Double_t>(size,0.));
+  nent.assign(nslices,0.);
+
+  all.push_back(this);
+}
+
+hist_block::~hist_block() {
+  delete proto;
+  all.erase(find(all.begin(),all.end(),this));
+}
+
+void hist_block::fill(const Double_t* c) noexcept {
+  const Double_t x = c[0], y = (is2d||isprof ? c[1] : 0.);
+  const Int_t bx = xaxis.find(x);
+  size_t cell = bx;
+  if (is2d) cell += nx2*yaxis.find(y);
+  // as in TH1::Fill, statistics exclude underflow and overflow
+  const bool stat = nstat && bx>0 && bx<=xaxis.nbins();
+  const Double_t *s = c + (is2d||isprof ? 2 : 1);
+
+  // range of slices in every variable
+  size_t sl = 0;
+  for (size_t d=0,n=in.size();d<n;++d) {
+    const vector<double>& e = in[d].edges;
+    if (in[d].above) {
+      lo[d] = 0;
+      hi[d] = lower_bound(e.begin(),e.end(),s[d]) - e.begin();
+    } else {
+      hi[d] = upper_bound(e.begin(),e.end(),s[d]) - e.begin();
+      if (hi[d]==0 || hi[d]==e.size()) return;
+      lo[d] = hi[d]-1;
+    }
+    if (lo[d]==hi[d]) return;
+    idx[d] = lo[d];
+    sl += lo[d]*stride[d];
+  }
+
+  for (;;) {
+    size_t i = (sl*ncells + cell)*nval;
+    const size_t j = nslices*ncells*nval + sl*nstat;
+    if (grouped) {
+      if (!touched[i]) {
+        touched[i] = 1;
+        dirty.push_back(i);
+      }
+      i += ev;
+    }
+    for (auto& b : bufs) {
+      const Double_t w = b.first->is_float ? b.first->w.f : b.first->w.d;
+      b.second[i] += w;
+      if (isprof) {
+        b.second[i+1] += w*y;
+        b.second[i+2] += w*y*y;
+        b.second[i+3] += w*w;
+      } else if (!grouped) b.second[w2+i] += w*w;
+      if (stat) {
+        b.second[j  ] += w;
+        b.second[j+1] += w*w;
+        b.second[j+2] += w*x;
+        b.second[j+3] += w*x*x;
+      }
+    }
+    nent[sl] += 1;
+
+    // next combination of slices
+    size_t d = 0;
+    for (const size_t n=in.size();d<n;++d) {
+      if (++idx[d] < hi[d]) { sl += stride[d]; break; }
+      sl -= (hi[d]-1-lo[d])*stride[d];
+      idx[d] = lo[d];
+    }
+    if (d==in.size()) break;
+  }
+}
+
+void hist_block::commit() noexcept {
+  for (size_t i : dirty) {
+    touched[i] = 0;
+    for (auto& b : bufs) {
+      Double_t& w = b.second[ev+i];
+      b.second[i] += w;
+      b.second[w2+i] += w*w;
+      w = 0.;
+    }
+  }
+  dirty.clear();
+}
+
+void hist_block::write() {
+  commit();
+  for (size_t sl=0;sl<nslices;++sl) {
+    // substitute slice labels into the name template
+    string sname;
+    for (size_t d=0,k=0;d<=in.size();++d) {
+      const size_t p = name.find('%',k);
+      sname.append(name,k,p==string::npos ? p : p-k);
+      if (d==in.size()) break;
+      const size_t j = (sl/stride[d]) % (in[d].above ? in[d].edges.size()
+                                                     : in[d].edges.size()-1);
+      stringstream ss;
+      ss << in[d].edges[j];
+      if (!in[d].above) ss << '_' << in[d].edges[j+1];
+      sname += ss.str();
+      k = p+1;
+    }
+
+    for (auto& b : bufs) {
+      hist::dirs[b.first]->cd();
+      TH1* h = hist::css->mkhist(name);
+      h->SetName(sname.c_str());
+      const Double_t *x = &b.second[sl*ncells*nval];
+      if (!isprof) {
+        if (!h->GetSumw2N()) h->Sumw2();
+        TArrayD& sumw2 = *h->GetSumw2();
+        for (size_t i=0;i<ncells;++i) sumw2[i] = b.second[w2+sl*ncells+i];
+      }
+      if (isprof) {
+        TProfile *p = static_cast<TProfile*>(h);
+        if (!p->GetBinSumw2()->GetSize()) p->Sumw2();
+        TArrayD& binsumw2 = *p->GetBinSumw2();
+        for (size_t i=0;i<ncells;++i,x+=nval) {
+          p->SetBinEntries(i,x[0]);
+          p->SetBinContent(i,x[1]);
+          (*p->GetSumw2())[i] = x[2];
+          binsumw2[i] = x[3];
+        }
+        p->ResetStats(); // means and RMS from the bins
+      } else for (size_t i=0;i<ncells;++i,x+=nval) h->SetBinContent(i,x[0]);
+      if (nstat) {
+        Double_t stats[4];
+        copy_n(&b.second[nslices*ncells*nval + sl*nstat],4,stats);
+        h->PutStats(stats);
+      }
+      h->SetEntries(nent[sl]);
+    }
+  }
+}
+
+void hist_block::commit_all() noexcept {
+  for (hist_block* h : all) h->commit();
+}
+
+void hist_block::write_all() {
+  for (hist_block* h : all) h->write();
+}
+
+size_t hist_block::shared_size() noexcept {
+  size_t size = 0;
+  for (hist_block* h : all) size += h->bufs.size()*h->ev + h->nslices;
+  return size;
+}
+
+Double_t* hist_block::save_all(Double_t* p) noexcept {
+  for (hist_block* h : all) {
+    for (auto& b : h->bufs) p = copy_n(b.second.begin(),h->ev,p);
+    p = copy(h->nent.begin(),h->nent.end(),p);
+  }
+  return p;
+}
+
+const Double_t* hist_block::add_all(const Double_t* p) noexcept {
+  for (hist_block* h : all) {
+    for (auto& b : h->bufs)
+      for (size_t i=0;i<h->ev;++i) b.second[i] += *p++;
+    for (auto& n : h->nent) n += *p++;
+  }
+  return p;
+}
+
+bool hist_block::group_events = false;
+vector<hist_block*> hist_block::all;
+
+// Histogram wrapper ************************************************
+
+unique_ptr<const csshists> hist::css;
+unordered_map<const weight*,TDirectory*> hist::dirs;
@@ -0,0 +1,116 @@
+#ifndef hist_hh
+#define hist_hh
+
+#include <string>
+#include <unordered_map>
+#include <memory>
+#include <vector>
+#include <utility>
+#include <cassert>
+
+#include <TH1.h>
+
+#include "weight.hh"
+#include "csshists.hh"
+
+class TAxis;
+class TDirectory;
+
+// Axis accelerator *************************************************
+// Bin lookup without the virtual calls of TH1::Fill. Uniform axes use
+// the expression of TAxis::FindFixBin, so that rounding next to the
+// edges is the same. For variable edges, a lookup table precomputed
+// at booking gives the lowest possible bin, followed by a short
+// forward scan, instead of a binary search.
+
+class fast_axis {
+  Double_t lo, hi, len, inv;
+  Int_t n;
+  std::vector<Double_t> edges; // empty for uniform bins
+  std::vector<Int_t> lut;
+
+public:
+  fast_axis(const TAxis* axis);
+
+  Int_t find(Double_t x) const noexcept {
+    if (x < lo) return 0;
+    if (!(x < hi)) return n+1; // overflow, including NaN
+    if (edges.empty()) return 1 + Int_t(n*(x-lo)/len);
+    Int_t b = lut[Int_t((x-lo)*inv)];
+    while (x >= edges[b]) ++b;
+    return b;
+  }
+
+  Int_t nbins() const noexcept { return n; }
+};
+
+// Histograms in contiguous storage *********************************
+// A TH1, TH2 or TProfile family, with all its BinnedIn slices, is
+// filled into one flat buffer per weight. The name is a template with
+// a % for every BinnedIn variable. ROOT histograms are only made by
+// write(), which must be called before the output file is written.
+// Every bin keeps the sum of squares of its weights, as TH1::Fill
+// does for weights other than 1.
+//
+// With group_events, weights of entries from the same event (eid) are
+// summed in an event buffer, and commit() adds the sums to the bins
+// and their squares to the sums of squares, instead of the squares of
+// the weights of single entries. commit_all() must be called when the
+// eid changes.
+
+class hist_block {
+  std::string name;
+  TH1 *proto; // axes of every slice
+  bool is2d, isprof, grouped;
+  fast_axis xaxis, yaxis;
+  size_t nx2, ncells, nval, nslices, nstat;
+  size_t w2, ev; // offsets of sums of squares and event buffer
+
+  std::vector<size_t> dirty; // cells filled in the current event
+  std::vector<char> touched;
+
+  std::vector<csshists::binned_in> in;
+  std::vector<size_t> stride, lo, hi, idx;
+
+  std::vector<std::pair<const weight*,std::vector<Double_t>>> bufs;
+  std::vector<Double_t> nent; // entries per slice
+
+  void fill(const Double_t* c) noexcept;
+
+public:
+  hist_block(const std::string& name);
+  ~hist_block();
+
+  // x (y for TH2 and TProfile) followed by the BinnedIn variables
+  template<typename... T>
+  void Fill(T... c) noexcept {
+    assert(sizeof...(T) == (is2d||isprof ? 2 : 1) + in.size());
+    const Double_t _c[] = { Double_t(c)... };
+    fill(_c);
+  }
+
+  void commit() noexcept;
+  void write();
+
+  static bool group_events;
+  static std::vector<hist_block*> all;
+  static void commit_all() noexcept;
+  static void write_all();
+
+  // Committed sums of all blocks, for reduction across processes
+  static size_t shared_size() noexcept;
+  static Double_t* save_all(Double_t* p) noexcept;
+  static const Double_t* add_all(const Double_t* p) noexcept;
+};
+
+// Histogram wrapper ************************************************
+
+class hist: public hist_block {
+public:
+  hist(const std::string& name): hist_block(name) { }
+
+  static std::unique_ptr<const csshists> css;
+  static std::unordered_map<const weight*,TDirectory*> dirs;
+};
+
+#endif
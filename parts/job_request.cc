@@ -0,0 +1,97 @@
+#include "job_request.hh"
+
+#include <cstring>
+#include <cstdlib>
+#include <cstdint>
+
+#include <unistd.h>
+#include <sys/socket.h>
+
+using namespace std;
+
+// all of the bytes, unless the peer is gone
+static bool write_all(int fd, const char* p, size_t n) {
+  while (n) {
+    const ssize_t k = ::write(fd, p, n);
+    if (k <= 0) return false;
+    p += k;
+    n -= k;
+  }
+  return true;
+}
+static bool read_all(int fd, char* p, size_t n) {
+  while (n) {
+    const ssize_t k = ::read(fd, p, n);
+    if (k <= 0) return false;
+    p += k;
+    n -= k;
+  }
+  return true;
+}
+
+bool job_request::send(int sock) const {
+  string msg = cwd;
+  msg += '\0';
+  for (const auto& a : args) {
+    msg += a;
+    msg += '\0';
+  }
+  uint32_t size = msg.size();
+
+  // descriptors go with the size
+  const int fds[2] = { out, err };
+  char ctrl[CMSG_SPACE(sizeof(fds))];
+  memset(ctrl, 0, sizeof(ctrl));
+  iovec iov { &size, sizeof(size) };
+  msghdr hdr { };
+  hdr.msg_iov = &iov;
+  hdr.msg_iovlen = 1;
+  hdr.msg_control = ctrl;
+  hdr.msg_controllen = sizeof(ctrl);
+  cmsghdr *cmsg = CMSG_FIRSTHDR(&hdr);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+  memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+  if (sendmsg(sock, &hdr, 0) != sizeof(size)) return false;
+  return write_all(sock, msg.data(), msg.size());
+}
+
+bool job_request::recv(int sock) {
+  uint32_t size;
+  int fds[2];
+  char ctrl[CMSG_SPACE(sizeof(fds))];
+  iovec iov { &size, sizeof(size) };
+  msghdr hdr { };
+  hdr.msg_iov = &iov;
+  hdr.msg_iovlen = 1;
+  hdr.msg_control = ctrl;
+  hdr.msg_controllen = sizeof(ctrl);
+
+  if (recvmsg(sock, &hdr, MSG_WAITALL) != sizeof(size)) return false;
+  cmsghdr *cmsg = CMSG_FIRSTHDR(&hdr);
+  if (!cmsg || cmsg->cmsg_type != SCM_RIGHTS ||
+      cmsg->cmsg_len != CMSG_LEN(sizeof(fds))) return false;
+  memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+  out = fds[0];
+  err = fds[1];
+
+  string msg(size, '\0');
+  if (!read_all(sock, &msg[0], size)) return false;
+
+  // working directory, then the arguments
+  args.clear();
+  for (size_t k=0, p; k<size; k=p+1) {
+    p = msg.find('\0', k);
+    if (p == string::npos) return false;
+    if (k) args.emplace_back(msg, k, p-k);
+    else cwd.assign(msg, 0, p);
+  }
+  return !args.empty();
+}
+
+string job_request::socket_path() {
+  if (const char *env = getenv("BHD_SOCKET")) return env;
+  return "/tmp/bhd-" + to_string(getuid()) + ".sock";
+}
@@ -0,0 +1,32 @@
+#ifndef job_request_hh
+#define job_request_hh
+
+#include <string>
+#include <vector>
+
+// Job requests to bhd **********************************************
+// A client connects to the Unix socket of bhd and sends the size of
+// the request together with its stdout and stderr descriptors, then
+// the working directory, the program and its arguments, each ended by
+// '\0'. The job writes directly to the client's descriptors, and bhd
+// replies with the exit status of the job, as an int.
+
+struct job_request {
+  std::string cwd;
+  std::vector<std::string> args; // program and its arguments
+  int out, err;
+
+  job_request(): out(-1), err(-1) { }
+
+  bool send(int sock) const;
+  // descriptors are new ones in the receiving process
+  bool recv(int sock);
+
+  // $BHD_SOCKET, or /tmp/bhd-<uid>.sock
+  static std::string socket_path();
+};
+
+// Programs built as job modules of bhd define this instead of main
+extern "C" int bhd_job(int argc, char** argv);
+
+#endif
@@ -0,0 +1,54 @@
+#include "lockstep.hh"
+
+#include <iostream>
+#include <algorithm>
+
+#include <TChain.h>
+
+using namespace std;
+
+lockstep::lockstep(initializer_list<TChain*> list)
+: seg_first(0), seg_last(0)
+{
+  for (TChain *chain : list) if (chain) chains.push_back(chain);
+  cur.resize(chains.size());
+  offset.resize(chains.size());
+
+  // offsets are known once all files are opened by GetEntries
+  // entries past the end of the shortest chain are not read
+  Long64_t nent = -1;
+  for (TChain *chain : chains) {
+    const Long64_t n = chain->GetEntries();
+    if (nent < 0 || n < nent) nent = n;
+    const Long64_t *off = chain->GetTreeOffset();
+    bounds.insert(bounds.end(), off, off+chain->GetNtrees());
+  }
+  if (nent < 0) nent = 0;
+  bounds.erase(remove_if(bounds.begin(),bounds.end(),
+    [nent](Long64_t b){ return b >= nent; }), bounds.end());
+  bounds.push_back(0);
+  bounds.push_back(nent);
+  sort(bounds.begin(),bounds.end());
+  bounds.erase(unique(bounds.begin(),bounds.end()),bounds.end());
+}
+
+void lockstep::load(Long64_t ent) {
+  const auto it = upper_bound(bounds.begin(),bounds.end(),ent);
+  if (it==bounds.begin() || it==bounds.end()) {
+    cerr << "\033[31mEntry " << ent << " is out of range\033[0m" << endl;
+    exit(1);
+  }
+  seg_first = *(it-1);
+  seg_last  = *it;
+
+  for (size_t i=0, n=chains.size(); i<n; ++i) {
+    const Long64_t local = chains[i]->LoadTree(ent);
+    if (local < 0) {
+      cerr << "\033[31mCannot load entry " << ent << " of "
+           << chains[i]->GetName() << " chain\033[0m" << endl;
+      exit(1);
+    }
+    cur[i] = chains[i]->GetTree();
+    offset[i] = ent - local;
+  }
+}
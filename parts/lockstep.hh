@@ -0,0 +1,42 @@
+#ifndef lockstep_hh
+#define lockstep_hh
+
+#include <vector>
+#include <initializer_list>
+
+#include <TTree.h>
+
+class TChain;
+
+// Lockstep reading of parallel chains ******************************
+// Entries of the chains correspond one to one, but their files may be
+// split at different entries. The entry range is cut into segments at
+// the file boundaries of every chain. Within a segment, entries are
+// read directly from the loaded tree of each chain, and no chain loads
+// a file. This replaces friending the chains.
+
+class lockstep {
+  std::vector<TChain*> chains;
+  std::vector<Long64_t> bounds; // segment boundaries, as global entries
+  std::vector<TTree*> cur;      // loaded trees
+  std::vector<Long64_t> offset; // first entry of each loaded tree
+  Long64_t seg_first, seg_last;
+
+  void load(Long64_t ent);
+
+public:
+  // null chains are skipped
+  lockstep(std::initializer_list<TChain*> chains);
+
+  Int_t GetEntry(Long64_t ent) {
+    if (ent < seg_first || ent >= seg_last) load(ent);
+    Int_t nbytes = 0;
+    for (size_t i=0, n=cur.size(); i<n; ++i)
+      nbytes += cur[i]->GetEntry(ent-offset[i]);
+    return nbytes;
+  }
+
+  size_t nsegments() const noexcept { return bounds.size()-1; }
+};
+
+#endif
@@ -0,0 +1,67 @@
+#include "ranks.hh"
+
+#include <iostream>
+#include <cstdlib>
+
+#ifdef USE_MPI
+#include <mpi.h>
+#endif
+
+using namespace std;
+
+#ifdef USE_MPI
+
+static void abort_at_exit() {
+  int finalized;
+  MPI_Finalized(&finalized);
+  if (!finalized) MPI_Abort(MPI_COMM_WORLD, 1);
+}
+
+ranks::ranks(int& argc, char**& argv) {
+  MPI_Init(&argc, &argv);
+  MPI_Comm_rank(MPI_COMM_WORLD, &_rank);
+  MPI_Comm_size(MPI_COMM_WORLD, &_size);
+  atexit(abort_at_exit);
+}
+
+ranks::~ranks() { MPI_Finalize(); }
+
+void ranks::abort(int code) const {
+  cout.flush();
+  cerr.flush();
+  MPI_Abort(MPI_COMM_WORLD, code);
+  exit(code); // not reached
+}
+
+void ranks::sum(Double_t* buf, size_t n) const {
+  // chunks keep the count within int
+  for (size_t i=0, m; i<n; i+=m) {
+    m = min(n-i, size_t(1)<<30);
+    if (_rank) MPI_Reduce(buf+i, nullptr, m, MPI_DOUBLE, MPI_SUM,
+                          0, MPI_COMM_WORLD);
+    else MPI_Reduce(MPI_IN_PLACE, buf+i, m, MPI_DOUBLE, MPI_SUM,
+                    0, MPI_COMM_WORLD);
+  }
+}
+
+void ranks::gather(char* buf, const vector<int>& counts) const {
+  vector<int> displs(counts.size());
+  for (size_t i=1; i<counts.size(); ++i)
+    displs[i] = displs[i-1] + counts[i-1];
+  if (_rank) MPI_Gatherv(buf+displs[_rank], counts[_rank], MPI_BYTE,
+                         nullptr, nullptr, nullptr, MPI_BYTE,
+                         0, MPI_COMM_WORLD);
+  else MPI_Gatherv(MPI_IN_PLACE, 0, MPI_BYTE,
+                   buf, counts.data(), displs.data(), MPI_BYTE,
+                   0, MPI_COMM_WORLD);
+}
+
+#else
+
+ranks::ranks(int& argc, char**& argv): _rank(0), _size(1) { }
+ranks::~ranks() { }
+void ranks::abort(int code) const { exit(code); }
+void ranks::sum(Double_t* buf, size_t n) const { }
+void ranks::gather(char* buf, const vector<int>& counts) const { }
+
+#endif
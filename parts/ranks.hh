@@ -0,0 +1,36 @@
+#ifndef ranks_hh
+#define ranks_hh
+
+#include <vector>
+
+#include <Rtypes.h>
+
+// MPI ranks ********************************************************
+// Built with USE_MPI by make mpi. Otherwise there is one rank,
+// and nothing is exchanged. An exit before the ranks are finalized,
+// e.g. from an error in parts, aborts all ranks, so that none is left
+// waiting in a reduction.
+
+class ranks {
+  int _rank, _size;
+
+public:
+  ranks(int& argc, char**& argv);
+  ~ranks();
+
+  // ends all ranks, for errors on any of them
+  [[noreturn]] void abort(int code) const;
+
+  int rank() const noexcept { return _rank; }
+  int size() const noexcept { return _size; }
+
+  // sum of the buffers of all ranks, on rank 0
+  void sum(Double_t* buf, size_t n) const;
+
+  // rank i sends bytes [displ_i, displ_i+counts[i]) of buf, where
+  // displ_i is the sum of the preceding counts, to the same bytes
+  // of buf on rank 0
+  void gather(char* buf, const std::vector<int>& counts) const;
+};
+
+#endif
@@ -23,32 +23,50 @@ constexpr array<int,10> quarks {
 
 template<typename T> inline T sq(T x) noexcept { return x*x; }
 
-// PDF variables
-string pdfname("def");
-const LHAPDF::PDFSet* pdfset(nullptr);
-vector<LHAPDF::PDF*> pdfs;
-const LHAPDF::PDF* pdf; // central PDF
-size_t npdfs;
-double alphas_mH;
-
-// PDF garbage collector
-struct PDFgc {
-  inline void clear() {
-    delete pdfset;
-    for ( auto pdf : pdfs ) delete pdf;
+//-----------------------------------------------
+// PDF set
+//-----------------------------------------------
+
+pdf_set::pdf_set(const string& setname): shared(nullptr) {
+  const auto it = preloaded.find(setname);
+  if (it!=preloaded.end()) {
+    shared = it->second;
+    set = shared->set;
+    pdfs = shared->pdfs;
+    xfx.resize(shared->xfx.size());
+    name = shared->name;
+    central = shared->central;
+    alphas_mH = shared->alphas_mH;
+    return;
   }
-  ~PDFgc() { clear(); }
-} __pdf;
-
-// Function to make PDFs
-void usePDFset(const std::string& setname) {
-  __pdf.clear();
-  pdfset = new LHAPDF::PDFSet(setname);
-  pdfname = pdfset->name();
-  pdfs = pdfset->mkPDFs();
-  pdf = pdfs[0];
-  npdfs = pdfs.size();
-  alphas_mH = pdf->alphasQ(125.);
+
+  set = new LHAPDF::PDFSet(setname);
+  name = set->name();
+  // only the central member is needed unless PDF uncertainties are requested
+  pdfs.assign(set->size(),nullptr);
+  central = pdfs[0] = set->mkPDF(0);
+  alphas_mH = central->alphasQ(125.);
+}
+
+pdf_set::~pdf_set() {
+  for (size_t i=0,n=pdfs.size();i<n;++i)
+    if (!shared || pdfs[i]!=shared->pdfs[i]) delete pdfs[i];
+  if (!shared) delete set;
+}
+
+void pdf_set::mkmembers() {
+  for (size_t i=1,n=pdfs.size();i<n;++i)
+    if (!pdfs[i]) pdfs[i] = set->mkPDF(i);
+  xfx.resize(pdfs.size());
+}
+
+unordered_map<string,pdf_set*> pdf_set::preloaded;
+
+void pdf_set::preload(const string& setname, bool members) {
+  auto it = preloaded.find(setname);
+  if (it==preloaded.end()) // kept for the lifetime of the process
+    it = preloaded.emplace(setname, new pdf_set(setname)).first;
+  if (members) it->second->mkmembers();
 }
 
 //-----------------------------------------------
@@ -76,16 +94,25 @@ double mu_ren_default::mu() const noexcept { return event.ren_scale; }
 
 // Factorization --------------------------------
 
-fac_calc::fac_calc(const mu_fcn* mu_f) noexcept
-: pdf_unc(false), defaultPDF(false), mu_f(mu_f) { }
+fac_calc::fac_calc(const mu_fcn* mu_f, const pdf_set* pdf) noexcept
+: pdf_unc(false), defaultPDF(false), mu_f(mu_f), pdf(pdf) { }
+
+fac_calc::fac_calc(const fac_calc& other, const pdf_set* pdf) noexcept
+: pdf_unc(other.pdf_unc), defaultPDF(other.defaultPDF),
+  mu_f(other.mu_f), pdf(pdf) { }
 
 fac_calc::~fac_calc() { }
 
 // Renormalization ------------------------------
 
-ren_calc::ren_calc(const mu_fcn* mu_r) noexcept
+ren_calc::ren_calc(const mu_fcn* mu_r, const pdf_set* pdf) noexcept
 : new_alphas(alphas_fcn::all_ren), defaultPDF(false),
-  mu_r(mu_r), ar(1.)
+  mu_r(mu_r), pdf(pdf), ar(1.)
+{ }
+
+ren_calc::ren_calc(const ren_calc& other, const pdf_set* pdf) noexcept
+: new_alphas(other.new_alphas), defaultPDF(other.defaultPDF),
+  mu_r(other.mu_r), pdf(pdf), ar(1.)
 { }
 
 ren_calc::~ren_calc() { }
@@ -100,17 +127,23 @@ reweighter::reweighter(const pair<const fac_calc*,string>& fac,
                        TTree* tree, bool pdf_unc)
 : fac(fac.first), ren(ren.first), pdf_unc(pdf_unc), nk(pdf_unc ? 3 : 1)
 {
-  if (!pdfset) {
+  if (!fac.first->pdf || !ren.first->pdf) {
     cerr << "\033[31mNo PDF loaded\033[0m"  << endl;
     exit(1);
   }
+  if (fac.first->pdf != ren.first->pdf &&
+      !fac.first->defaultPDF && !ren.first->defaultPDF) {
+    cerr << "\033[31mDifferent PDF sets for fac " << fac.second
+         << " and ren " << ren.second << "\033[0m" << endl;
+    exit(1);
+  }
 
   string name("Fac");
   name += fac.second;
   name += "_Ren";
   name += ren.second;
   name += "_PDF";
-  name += pdfname;
+  name += (fac.first->defaultPDF ? ren.first->pdf : fac.first->pdf)->name;
 
   cout << "Creating branch: " << name << endl;
   tree->Branch(name.c_str(), &weight[0], (name+"/F").c_str());
@@ -147,19 +180,18 @@ reweighter::~reweighter() { }
 // Factorization
 //-----------------------------------------------
 
-inline double quark_sum(double x, double mu_fac) noexcept {
+double pdf_set::quark_sum(double x, double mu_fac) const noexcept {
   double f = 0.;
-  for (int q : quarks) f += pdf->xfxQ(q, x, mu_fac);
+  for (int q : quarks) f += central->xfxQ(q, x, mu_fac);
   return f;
 }
 
 // Get PDF lower and upper bound
-valarray<double> xfxQ_unc(int id, double x, double q) noexcept {
-  static vector<double> xfx(npdfs);
-  for (size_t j=0;j<npdfs;++j) xfx[j] = pdfs[j]->xfxQ(id, x, q);
+valarray<double> pdf_set::xfxQ_unc(int id, double x, double q) const noexcept {
+  for (size_t j=0,n=xfx.size();j<n;++j) xfx[j] = pdfs[j]->xfxQ(id, x, q);
 
   static LHAPDF::PDFUncertainty xErr;
-  pdfset->uncertainty(xErr, xfx); // no 3rd arg => use default 1 sigma
+  set->uncertainty(xErr, xfx); // no 3rd arg => use default 1 sigma
 
   return {
     xErr.central - xErr.errminus, // down
@@ -167,7 +199,7 @@ valarray<double> xfxQ_unc(int id, double x, double q) noexcept {
   };
 }
 
-valarray<double> quark_sum_unc(double x, double mu_fac) noexcept {
+valarray<double> pdf_set::quark_sum_unc(double x, double mu_fac) const noexcept {
   valarray<double> f(0.,2);
   for (int q : quarks) f += xfxQ_unc(q, x, mu_fac);
   return f;
@@ -184,17 +216,17 @@ void fac_calc::calc() const noexcept {
   static const char& part = event.part[0];
   static Double_t* const& usr_wgts = event.usr_wgts;
 
-  const double mu = mu_f->mu();
+  const double mu = mu_f->val();
 
   // Born & Real
   if (defaultPDF) m[0] = event.weight;
   else {
     for (short i=0;i<2;++i)
-      f[0][i][0] = pdf->xfxQ(event.id[i], event.x[i], mu)/event.x[i];
+      f[0][i][0] = pdf->central->xfxQ(event.id[i], event.x[i], mu)/event.x[i];
 
     // PDF uncertainty
     if (pdf_unc) for (short i=0;i<2;++i)
-      unfold( xfxQ_unc(event.id[i], event.x[i], mu)/event.x[i],
+      unfold( pdf->xfxQ_unc(event.id[i], event.x[i], mu)/event.x[i],
               f[1][i][0], f[2][i][0] );
 
     m[0] = event.me_wgt2;
@@ -218,25 +250,27 @@ void fac_calc::calc() const noexcept {
       xp = event.xp[i];
 
       f[0][i][1] = ( id==21 // Eq. (46)
-                   ? quark_sum(    x, mu)/x
-                   : pdf->xfxQ(id, x, mu)/x
+                   ? pdf->quark_sum(        x, mu)/x
+                   : pdf->central->xfxQ(id, x, mu)/x
       );
       f[0][i][2] = ( id==21 // Eq. (47)
-                   ? quark_sum(    x/xp, mu)/x
-                   : pdf->xfxQ(id, x/xp, mu)/x
+                   ? pdf->quark_sum(        x/xp, mu)/x
+                   : pdf->central->xfxQ(id, x/xp, mu)/x
       );
-      f[0][i][3] = pdf->xfxQ(21, x,    mu)/x; // Eq. (48)
-      f[0][i][4] = pdf->xfxQ(21, x/xp, mu)/x; // Eq. (49)
+      f[0][i][3] = pdf->central->xfxQ(21, x,    mu)/x; // Eq. (48)
+      f[0][i][4] = pdf->central->xfxQ(21, x/xp, mu)/x; // Eq. (49)
 
       if (pdf_unc) { // PDF uncertainty
-        unfold( id==21 ? quark_sum_unc(x,    mu)/x : xfxQ_unc(id, x,    mu)/x,
+        unfold( id==21 ? pdf->quark_sum_unc(x,    mu)/x
+                       : pdf->xfxQ_unc(id, x,    mu)/x,
                 f[1][i][1], f[2][i][1]
         ); // Eq. (46)
-        unfold( id==21 ? quark_sum_unc(x/xp, mu)/x : xfxQ_unc(id, x/xp, mu)/x,
+        unfold( id==21 ? pdf->quark_sum_unc(x/xp, mu)/x
+                       : pdf->xfxQ_unc(id, x/xp, mu)/x,
                 f[1][i][2], f[2][i][2]
         ); // Eq. (47)
-        unfold( xfxQ_unc(21, x,    mu)/x, f[1][i][3], f[2][i][3] ); // Eq. (48)
-        unfold( xfxQ_unc(21, x/xp, mu)/x, f[1][i][4], f[2][i][4] ); // Eq. (49)
+        unfold( pdf->xfxQ_unc(21, x,    mu)/x, f[1][i][3], f[2][i][3] ); // Eq. (48)
+        unfold( pdf->xfxQ_unc(21, x/xp, mu)/x, f[1][i][4], f[2][i][4] ); // Eq. (49)
       }
     }
     for (short k=0,nk=(pdf_unc?3:1);k<nk;++k) {
@@ -264,11 +298,12 @@ void ren_calc::calc() const noexcept {
   static const Double_t& ren_scale = event.ren_scale;
   static Double_t* const& usr_wgts = event.usr_wgts;
 
-  const double mu = mu_r->mu();
+  const double mu = mu_r->val();
+  const double alphas_mH = pdf->alphas_mH;
 
   // Calculate α_s change from renormalization
   if (!defaultPDF) {
-    const double to_alphas = pdf->alphasQ(mu);
+    const double to_alphas = pdf->central->alphasQ(mu);
     if (new_alphas == alphas_fcn::two_mH) {
       ar = pow(to_alphas/alphas, n-2);
       if (bh_alphas != alphas_fcn::two_mH) {
@@ -316,3 +351,7 @@ void reweighter::stitch() const noexcept {
     }
   }
 }
+
+void reweighter::zero() const noexcept {
+  for (short k=0;k<nk;++k) weight[k] = 0.;
+}
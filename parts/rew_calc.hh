@@ -3,23 +3,70 @@
 
 #include <string>
 #include <vector>
+#include <unordered_map>
 #include <algorithm>
 
+#include <valarray>
+
 #include "BHEvent.hh"
 
 extern BHEvent event;
 
-// Function to make PDFs
-void usePDFset(const std::string& setname);
+namespace LHAPDF {
+  class PDF;
+  class PDFSet;
+}
+
+//-----------------------------------------------
+// PDF set --------------------------------------
+//-----------------------------------------------
+
+class pdf_set {
+  const LHAPDF::PDFSet* set;
+  std::vector<LHAPDF::PDF*> pdfs; // error members are loaded on demand
+  mutable std::vector<double> xfx;
+  const pdf_set* shared; // preloaded set, whose members are not deleted
+
+  static std::unordered_map<std::string,pdf_set*> preloaded;
+
+public:
+  std::string name;
+  const LHAPDF::PDF* central;
+  double alphas_mH;
+
+  // Constructor makes only the central member
+  pdf_set(const std::string& setname);
+  ~pdf_set();
+
+  // Make error members
+  // Has to be called before PDF uncertainties are calculated
+  void mkmembers();
+
+  // Sets loaded once, e.g. by bhd, are shared by every pdf_set
+  // of the same name in the jobs it forks
+  static void preload(const std::string& setname, bool members=false);
+
+  double quark_sum(double x, double q) const noexcept;
+
+  // PDF lower and upper bounds
+  std::valarray<double> xfxQ_unc(int id, double x, double q) const noexcept;
+  std::valarray<double> quark_sum_unc(double x, double q) const noexcept;
+};
 
 //-----------------------------------------------
 // Function classes to get scales values
 //-----------------------------------------------
 
 class mu_fcn {
+  mutable double _val;
 public:
   virtual double mu() const noexcept =0;
   virtual ~mu_fcn() noexcept { }
+
+  // Value is calculated once per event
+  // and shared by all fac and ren using this energy
+  void calc() const noexcept { _val = mu(); }
+  double val() const noexcept { return _val; }
 };
 
 class mu_fixed: public mu_fcn {
@@ -67,15 +114,18 @@ public:
 class reweighter;
 
 struct fac_calc {
-  fac_calc(const mu_fcn* mu_f) noexcept;
+  fac_calc(const mu_fcn* mu_f, const pdf_set* pdf) noexcept;
+  fac_calc(const fac_calc& other, const pdf_set* pdf) noexcept;
   void calc() const noexcept;
   ~fac_calc();
 
   bool pdf_unc;
   bool defaultPDF;
 
+  const mu_fcn* const mu_f;
+  const pdf_set* const pdf;
+
 private:
-  const mu_fcn* mu_f;
   mutable double f[3][2][5], m[9], lf, si[3];
 
 friend class reweighter;
@@ -88,7 +138,8 @@ friend class reweighter;
 enum class alphas_fcn: char { all_ren, two_mH };
 
 struct ren_calc {
-  ren_calc(const mu_fcn* mu_r) noexcept;
+  ren_calc(const mu_fcn* mu_r, const pdf_set* pdf) noexcept;
+  ren_calc(const ren_calc& other, const pdf_set* pdf) noexcept;
   void calc() const noexcept;
   ~ren_calc();
 
@@ -97,8 +148,10 @@ struct ren_calc {
 
   static alphas_fcn bh_alphas;
 
+  const mu_fcn* const mu_r;
+  const pdf_set* const pdf;
+
 private:
-  const mu_fcn* mu_r;
   mutable double ar, lr, m0;
 
 friend class reweighter;
@@ -125,6 +178,7 @@ public:
              TTree* tree, bool pdf_unc=false);
   ~reweighter();
   void stitch() const noexcept;
+  void zero() const noexcept; // for entries that are not reweighted
 };
 
 #endif
@@ -0,0 +1,173 @@
+#include "small_cluster.hh"
+
+#include <cmath>
+#include <algorithm>
+
+#include <fastjet/ClusterSequence.hh>
+
+using namespace std;
+using fastjet::PseudoJet;
+
+namespace {
+
+// As in PseudoJet::_finish_init
+constexpr double twopi = 2*M_PI, MaxRap = 1e5;
+
+struct particle {
+  double px, py, pz, E, kt2, rap, phi;
+
+  void set(double px_, double py_, double pz_, double E_) noexcept {
+    px = px_; py = py_; pz = pz_; E = E_;
+    kt2 = px*px + py*py;
+    phi = (kt2 == 0.0 ? 0.0 : atan2(py,px));
+    if (phi < 0.0) phi += twopi;
+    if (phi >= twopi) phi -= twopi;
+    if (E == abs(pz) && kt2 == 0) {
+      const double MaxRapHere = MaxRap + abs(pz);
+      rap = (pz >= 0.0 ? MaxRapHere : -MaxRapHere);
+    } else {
+      const double effective_m2 = max(0.0,(E+pz)*(E-pz)-kt2);
+      const double E_plus_pz = E + abs(pz);
+      rap = 0.5*log((kt2 + effective_m2)/(E_plus_pz*E_plus_pz));
+      if (pz > 0) rap = -rap;
+    }
+  }
+};
+
+// As fastjet::ClusterSequence's BriefJet, with indices for pointers
+struct brief_jet {
+  double eta, phi, kt2, NN_dist;
+  int NN, index;
+};
+
+}
+
+small_cluster::small_cluster(const fastjet::JetDefinition& def)
+: def(def), alg(def.jet_algorithm()), R2(def.R()*def.R()), invR2(1./R2),
+  ok( (alg==fastjet::kt_algorithm || alg==fastjet::antikt_algorithm ||
+       alg==fastjet::cambridge_algorithm) &&
+      def.recombination_scheme()==fastjet::E_scheme &&
+      (def.strategy()==fastjet::Best || def.strategy()==fastjet::N2Plain) )
+{ }
+
+vector<PseudoJet> small_cluster::inclusive_jets(
+  const vector<PseudoJet>& particles, double ptmin
+) const {
+  const int n0 = particles.size();
+  if (!handles(n0))
+    return fastjet::ClusterSequence(particles,def).inclusive_jets(ptmin);
+
+  // Jets and history of beam recombinations, on the stack
+  particle p[2*nmax];
+  int beam[nmax];
+  double beam_dij[nmax];
+  int nbeam = 0, np = n0;
+
+  brief_jet b[nmax];
+  double diJ[nmax];
+
+  auto set_jetinfo = [&](brief_jet& j, int i) {
+    j.eta = p[i].rap;
+    j.phi = p[i].phi;
+    if (alg==fastjet::kt_algorithm) j.kt2 = p[i].kt2;
+    else if (alg==fastjet::cambridge_algorithm) j.kt2 = 1.0;
+    else j.kt2 = (p[i].kt2 > 1e-300 ? 1.0/p[i].kt2 : 1e300);
+    j.NN_dist = R2;
+    j.NN = -1;
+    j.index = i;
+  };
+  auto dist = [&](int i, int j) {
+    double dphi = abs(b[i].phi - b[j].phi);
+    const double deta = b[i].eta - b[j].eta;
+    if (dphi > M_PI) dphi = twopi - dphi;
+    return dphi*dphi + deta*deta;
+  };
+  auto bj_diJ = [&](int i) {
+    double kt2 = b[i].kt2;
+    if (b[i].NN >= 0) if (b[b[i].NN].kt2 < kt2) kt2 = b[b[i].NN].kt2;
+    return b[i].NN_dist * kt2;
+  };
+
+  for (int i=0; i<n0; ++i) {
+    const PseudoJet& q = particles[i];
+    p[i].set(q.px(),q.py(),q.pz(),q.E());
+    set_jetinfo(b[i],i);
+  }
+
+  // Nearest neighbours, _bj_set_NN_crosscheck
+  for (int a=1; a<n0; ++a) {
+    double NN_dist = R2;
+    int NN = -1;
+    for (int c=0; c<a; ++c) {
+      const double d = dist(a,c);
+      if (d < NN_dist) { NN_dist = d; NN = c; }
+      if (d < b[c].NN_dist) { b[c].NN_dist = d; b[c].NN = a; }
+    }
+    b[a].NN = NN;
+    b[a].NN_dist = NN_dist;
+  }
+  for (int i=0; i<n0; ++i) diJ[i] = bj_diJ(i);
+
+  // Recombination loop, _simple_N2_cluster
+  for (int n=n0; n; ) {
+    double diJ_min = diJ[0];
+    int ja = 0;
+    for (int i=1; i<n; ++i)
+      if (diJ[i] < diJ_min) { ja = i; diJ_min = diJ[i]; }
+
+    int jb = b[ja].NN;
+    diJ_min *= invR2;
+    if (jb >= 0) {
+      if (ja < jb) swap(ja,jb);
+      const particle &pa = p[b[ja].index], &pb = p[b[jb].index];
+      p[np].set(pa.px+pb.px, pa.py+pb.py, pa.pz+pb.pz, pa.E+pb.E);
+      set_jetinfo(b[jb],np++);
+    } else {
+      beam[nbeam] = b[ja].index;
+      beam_dij[nbeam++] = diJ_min;
+    }
+
+    const int tail = --n;
+    b[ja] = b[tail];
+    diJ[ja] = diJ[tail];
+
+    for (int i=0; i<n; ++i) {
+      if (b[i].NN == ja || b[i].NN == jb) { // _bj_set_NN_nocross
+        double NN_dist = R2;
+        int NN = -1;
+        for (int c=0; c<n; ++c) {
+          if (c==i) continue;
+          const double d = dist(i,c);
+          if (d < NN_dist) { NN_dist = d; NN = c; }
+        }
+        b[i].NN = NN;
+        b[i].NN_dist = NN_dist;
+        diJ[i] = bj_diJ(i);
+      }
+      if (jb >= 0) {
+        const double d = dist(i,jb);
+        if (d < b[i].NN_dist && i != jb) {
+          b[i].NN_dist = d;
+          b[i].NN = jb;
+          diJ[i] = bj_diJ(i);
+        }
+        if (d < b[jb].NN_dist && i != jb) {
+          b[jb].NN_dist = d;
+          b[jb].NN = i;
+        }
+      }
+      if (b[i].NN == tail) b[i].NN = ja;
+    }
+    if (jb >= 0) diJ[jb] = bj_diJ(jb);
+  }
+
+  // Selection as in ClusterSequence::inclusive_jets, latest first
+  const double dcut = ptmin*ptmin;
+  vector<PseudoJet> jets;
+  for (int i=nbeam-1; i>=0; --i) {
+    const particle& j = p[beam[i]];
+    if (alg==fastjet::kt_algorithm ? beam_dij[i] >= dcut : j.kt2 >= dcut)
+      jets.emplace_back(j.px,j.py,j.pz,j.E);
+  }
+  return jets;
+}
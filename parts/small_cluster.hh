@@ -0,0 +1,36 @@
+#ifndef small_cluster_hh
+#define small_cluster_hh
+
+#include <cstddef>
+#include <vector>
+
+#include <fastjet/JetDefinition.hh>
+#include <fastjet/PseudoJet.hh>
+
+// Clustering of a few particles ************************************
+// For the low multiplicities of BlackHat events, FastJet chooses the
+// N2Plain strategy, and most of the time goes to setting up the
+// ClusterSequence. This repeats the N2Plain algorithm on stack arrays,
+// with the same arithmetic, so the jets are bit-identical. Larger
+// events, and definitions other than kt, anti-kt and Cambridge with
+// the E scheme, are passed to FastJet.
+
+class small_cluster {
+  fastjet::JetDefinition def;
+  fastjet::JetAlgorithm alg;
+  double R2, invR2;
+  bool ok;
+
+public:
+  static constexpr size_t nmax = 8;
+
+  small_cluster(const fastjet::JetDefinition& def);
+
+  // same jets, in the same order, as ClusterSequence::inclusive_jets
+  std::vector<fastjet::PseudoJet> inclusive_jets(
+    const std::vector<fastjet::PseudoJet>& particles, double ptmin) const;
+
+  bool handles(size_t n) const noexcept { return ok && n <= nmax; }
+};
+
+#endif
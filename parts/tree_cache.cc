@@ -0,0 +1,126 @@
+#include "tree_cache.hh"
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+
+#include <TEnv.h>
+#include <TFile.h>
+#include <TTree.h>
+#include <TChain.h>
+#include <TTreeCache.h>
+#include <TFriendElement.h>
+#include <TList.h>
+#include <TObjArray.h>
+
+#include "branches.hh"
+
+using namespace std;
+
+tree_cache::tree_cache(initializer_list<TTree*> list,
+                       Long64_t size, Int_t learn, bool prefetch)
+: prefetch(prefetch), stop(false)
+{
+  // registered branches of each tree, for it and its friends
+  vector<const vector<string>*> names;
+  for (TTree *tree : list) {
+    if (!tree) continue;
+    trees.push_back(tree);
+    names.push_back(&branches::of(tree));
+    if (TList *friends = tree->GetListOfFriends()) {
+      TIter next(friends);
+      while (TFriendElement *fe = (TFriendElement*)next())
+        if (TTree *t = fe->GetTree()) {
+          trees.push_back(t);
+          names.push_back(names.back());
+        }
+    }
+  }
+
+  // must be set before the caches are made
+  if (prefetch) gEnv->SetValue("TFile.AsyncPrefetching", 1);
+
+  if (size >= 0) for (TTree *t : trees) t->SetCacheSize(size*1024*1024);
+  if (size != 0) {
+    if (learn > 0) for (TTree *t : trees) t->SetCacheLearnEntries(learn);
+    else {
+      // a chain keeps the cached branches for every file it loads
+      for (size_t i=0, n=trees.size(); i<n; ++i) {
+        TTree *t = trees[i];
+        for (const auto& name : *names[i])
+          if (t->GetListOfBranches()->FindObject(name.c_str()))
+            t->AddBranchToCache(name.c_str(),kTRUE);
+        t->StopCacheLearningPhase();
+      }
+    }
+  }
+
+  if (prefetch) {
+    reader = thread([this]{
+      vector<char> buf(1<<22);
+      for (;;) {
+        string file;
+        {
+          unique_lock<mutex> lock(mx);
+          cv.wait(lock,[this]{ return stop || !files.empty(); });
+          if (stop) return;
+          file = move(files.front());
+          files.pop();
+        }
+        // only to get the file into the page cache
+        ifstream f(file, ios::binary);
+        while (f.read(buf.data(),buf.size()) && !stop) { }
+      }
+    });
+    // friends are loaded by their main tree, which notifies
+    for (TTree *tree : list) if (tree) tree->SetNotify(this);
+    Notify();
+  }
+}
+
+tree_cache::~tree_cache() {
+  {
+    lock_guard<mutex> lock(mx);
+    stop = true;
+  }
+  cv.notify_all();
+  if (reader.joinable()) reader.join();
+}
+
+void tree_cache::read_ahead(TChain* chain) {
+  const TObjArray *list = chain->GetListOfFiles();
+  const Int_t next = chain->GetTreeNumber()+1;
+  if (next >= list->GetEntries()) return;
+  const string file = list->At(next)->GetTitle();
+  if (file.find("://")!=string::npos) return; // only local or mounted files
+
+  if (!requested.insert(file).second) return;
+  {
+    lock_guard<mutex> lock(mx);
+    files.push(file);
+  }
+  cv.notify_one();
+}
+
+Bool_t tree_cache::Notify() {
+  for (TTree *t : trees)
+    if (TChain *chain = dynamic_cast<TChain*>(t)) read_ahead(chain);
+  return kTRUE;
+}
+
+void tree_cache::report(ostream& os) const {
+  const auto flags = os.flags();
+  os << "I/O: " << TFile::GetFileReadCalls() << " read calls, "
+     << fixed << setprecision(1) << TFile::GetFileBytesRead()/1048576.
+     << " MB read";
+  if (prefetch) os << ", " << requested.size() << " files read ahead";
+  os << endl;
+  for (const TTree *t : trees) {
+    const TTreeCache *tc = t->GetReadCache(t->GetCurrentFile());
+    if (!tc) continue;
+    os << "  " << t->GetName() << " cache: "
+       << tc->GetBufferSize()/1048576. << " MB, hit rate "
+       << 100.*tc->GetEfficiencyRel() << '%' << endl;
+  }
+  os.flags(flags);
+}
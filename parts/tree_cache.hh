@@ -0,0 +1,58 @@
+#ifndef tree_cache_hh
+#define tree_cache_hh
+
+#include <string>
+#include <vector>
+#include <initializer_list>
+#include <queue>
+#include <unordered_set>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <iosfwd>
+
+#include <TObject.h>
+
+class TTree;
+class TChain;
+
+// Read cache and prefetching ***************************************
+// Gives each tree and each of their friends a TTreeCache. With learn=0
+// the cache holds the branches registered in branches, without a
+// learning phase. With prefetch, baskets are read asynchronously, and
+// the next file of every chain is read in the background, so it is in
+// the page cache by the time the chain gets to it.
+//
+// Must be made after branches::prune, and outlive the event loop.
+// Report before the files are closed.
+
+class tree_cache: public TObject {
+  std::vector<TTree*> trees; // trees and their friends
+  bool prefetch;
+
+  // background reader of the next files
+  std::queue<std::string> files;
+  std::unordered_set<std::string> requested;
+  std::mutex mx;
+  std::condition_variable cv;
+  std::atomic<bool> stop;
+  std::thread reader;
+
+  void read_ahead(TChain* chain);
+
+public:
+  // size in MB, 0 disables the cache, negative keeps ROOT's default
+  // null trees are skipped
+  tree_cache(std::initializer_list<TTree*> trees,
+             Long64_t size, Int_t learn, bool prefetch);
+  ~tree_cache();
+
+  // called by a chain when it loads a new file
+  Bool_t Notify() override;
+
+  // read calls, bytes read, and cache hit rate of every tree
+  void report(std::ostream& os) const;
+};
+
+#endif
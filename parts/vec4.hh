@@ -0,0 +1,112 @@
+#ifndef vec4_hh
+#define vec4_hh
+
+#include <cmath>
+#include <cstddef>
+
+#include <Rtypes.h>
+
+// Lightweight 4-vector *********************************************
+// A POD replacement for TLorentzVector in event loops. Methods follow
+// TLorentzVector conventions. Derived quantities are computed on first
+// use and cached, or set by adapters which already know them.
+
+class vec4 {
+  Double_t px, py, pz, e;
+  mutable Double_t pt, y, phi, m, eta;
+  mutable unsigned char known;
+  enum : unsigned char { kPt=1, kY=2, kPhi=4, kM=8, kEta=16 };
+
+public:
+  vec4() noexcept = default;
+  vec4(Double_t px, Double_t py, Double_t pz, Double_t E) noexcept
+  : px(px), py(py), pz(pz), e(E), known(0) { }
+  // kinematics known in advance, e.g. from a jet ntuple
+  vec4(Double_t px, Double_t py, Double_t pz, Double_t E,
+       Double_t pt, Double_t y, Double_t phi, Double_t m) noexcept
+  : px(px), py(py), pz(pz), e(E), pt(pt), y(y), phi(phi), m(m),
+    known(kPt|kY|kPhi|kM) { }
+
+  // PseudoJet or any class with px(), py(), pz(), E(), rap() and m()
+  template<class P>
+  static vec4 pseudojet(const P& p) noexcept {
+    vec4 v(p.px(),p.py(),p.pz(),p.E());
+    v.y = p.rap();
+    v.m = p.m();
+    v.known = kY|kM;
+    return v;
+  }
+
+  Double_t Px() const noexcept { return px; }
+  Double_t Py() const noexcept { return py; }
+  Double_t Pz() const noexcept { return pz; }
+  Double_t E () const noexcept { return e;  }
+
+  Double_t Perp2() const noexcept { return px*px + py*py; }
+  Double_t M2() const noexcept { return e*e - px*px - py*py - pz*pz; }
+
+  Double_t Pt() const noexcept {
+    if (!(known & kPt)) { pt = std::sqrt(Perp2()); known |= kPt; }
+    return pt;
+  }
+  Double_t M() const noexcept {
+    if (!(known & kM)) {
+      const Double_t mm = M2();
+      m = mm < 0. ? -std::sqrt(-mm) : std::sqrt(mm);
+      known |= kM;
+    }
+    return m;
+  }
+  Double_t Rapidity() const noexcept {
+    if (!(known & kY)) { y = 0.5*std::log((e+pz)/(e-pz)); known |= kY; }
+    return y;
+  }
+  Double_t Phi() const noexcept {
+    if (!(known & kPhi)) { phi = std::atan2(py,px); known |= kPhi; }
+    return phi;
+  }
+  Double_t Eta() const noexcept {
+    if (!(known & kEta)) {
+      const Double_t pt = Pt();
+      if (pt > 0.) eta = std::asinh(pz/pt);
+      else eta = (pz == 0. ? 0. : (pz > 0. ? 10e10 : -10e10));
+      known |= kEta;
+    }
+    return eta;
+  }
+
+  Double_t DeltaPhi(const vec4& v) const noexcept {
+    Double_t d = Phi() - v.Phi();
+    if (d > M_PI) d -= 2*M_PI;
+    else if (d <= -M_PI) d += 2*M_PI;
+    return d;
+  }
+  Double_t DeltaR(const vec4& v) const noexcept {
+    const Double_t deta = Eta() - v.Eta(), dphi = DeltaPhi(v);
+    return std::sqrt( deta*deta + dphi*dphi );
+  }
+
+  vec4& operator+=(const vec4& v) noexcept {
+    px += v.px; py += v.py; pz += v.pz; e += v.e;
+    known = 0;
+    return *this;
+  }
+  vec4 operator+(const vec4& v) const noexcept {
+    return vec4(px+v.px, py+v.py, pz+v.pz, e+v.e);
+  }
+};
+
+// Batched kernels **************************************************
+// Loops over arrays of components, written to be vectorized
+
+inline void rapidities(size_t n, const Double_t* E, const Double_t* pz,
+                       Double_t* y) noexcept {
+  for (size_t i=0; i<n; ++i) y[i] = 0.5*std::log((E[i]+pz[i])/(E[i]-pz[i]));
+}
+
+inline void azimuths(size_t n, const Double_t* px, const Double_t* py,
+                     Double_t* phi) noexcept {
+  for (size_t i=0; i<n; ++i) phi[i] = std::atan2(py[i],px[i]);
+}
+
+#endif
@@ -1,5 +1,7 @@
 #include "weight.hh"
 
+#include "branches.hh"
+
 using namespace std;
 
 weight::weight(TTree *tree, const string& name, bool is_float)
@@ -9,6 +11,7 @@ weight::weight(TTree *tree, const string& name, bool is_float)
   if (br) {
     if (is_float) br->SetAddress(&w.f);
     else br->SetAddress(&w.d);
+    branches::use(tree,name);
   } else exit(1);
 }
 
@@ -0,0 +1,147 @@
+#include "workers.hh"
+
+#include <iostream>
+#include <cstring>
+#include <cstdlib>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include <TROOT.h>
+#include <TFile.h>
+#include <TTree.h>
+#include <TLeaf.h>
+#include <TH1.h>
+#include <TArrayD.h>
+#include <TObjArray.h>
+
+using namespace std;
+
+workers::workers(unsigned n, size_t bytes): n(n), bytes(bytes) {
+  mem = static_cast<char*>(mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+    MAP_SHARED | MAP_ANONYMOUS, -1, 0));
+  if (mem == MAP_FAILED) {
+    cerr << "\033[31mCannot map " << bytes
+         << " bytes of shared memory\033[0m" << endl;
+    exit(1);
+  }
+  pids.reserve(n);
+}
+
+workers::~workers() { munmap(mem, bytes); }
+
+int workers::fork() {
+  // buffered output would be written again by every worker
+  cout.flush();
+  cerr.flush();
+  fflush(nullptr);
+
+  for (unsigned i=0; i<n; ++i) {
+    const pid_t pid = ::fork();
+    if (pid < 0) {
+      cerr << "\033[31mCannot fork worker " << i << "\033[0m" << endl;
+      exit(1);
+    }
+    if (pid == 0) {
+      reopen_inputs();
+      return i;
+    }
+    pids.push_back(pid);
+  }
+  return -1;
+}
+
+void workers::wait() {
+  bool failed = false;
+  for (pid_t pid : pids) {
+    int status;
+    if (waitpid(pid, &status, 0) < 0 ||
+        !WIFEXITED(status) || WEXITSTATUS(status)) failed = true;
+  }
+  pids.clear();
+  if (failed) {
+    cerr << "\033[31mA worker failed\033[0m" << endl;
+    exit(1);
+  }
+}
+
+void workers::done() {
+  cout.flush();
+  cerr.flush();
+  _exit(0);
+}
+
+void workers::reopen_inputs() {
+  TIter next(gROOT->GetListOfFiles());
+  while (TFile *f = static_cast<TFile*>(next())) {
+    if (f->IsWritable()) continue;
+    const int fd = f->GetFd();
+    if (fd < 0) continue; // not a local file
+    const int nfd = open(f->GetName(), O_RDONLY);
+    if (nfd < 0 || dup2(nfd, fd) < 0) {
+      cerr << "\033[31mCannot reopen " << f->GetName() << "\033[0m" << endl;
+      _exit(1);
+    }
+    close(nfd);
+  }
+}
+
+size_t workers::shared_size(const TH1* h) {
+  return 2*h->GetNcells() + TH1::kNstat + 1;
+}
+
+Double_t* workers::save(const TH1* h, Double_t* p) {
+  const Int_t n = h->GetNcells();
+  const Double_t *w2 = h->GetSumw2N() ? h->GetSumw2()->GetArray() : nullptr;
+  for (Int_t i=0; i<n; ++i) {
+    *p++ = h->GetBinContent(i);
+    *p++ = w2 ? w2[i] : 0.;
+  }
+  h->GetStats(p);
+  p += TH1::kNstat;
+  *p++ = h->GetEntries();
+  return p;
+}
+
+const Double_t* workers::add(TH1* h, const Double_t* p) {
+  const Int_t n = h->GetNcells();
+  Double_t *w2 = h->GetSumw2N() ? h->GetSumw2()->GetArray() : nullptr;
+  Double_t stats[TH1::kNstat];
+  h->GetStats(stats);
+  const Double_t entries = h->GetEntries();
+  for (Int_t i=0; i<n; ++i) {
+    h->SetBinContent(i, h->GetBinContent(i) + *p++);
+    if (w2) w2[i] += *p;
+    ++p;
+  }
+  for (Int_t i=0; i<TH1::kNstat; ++i) stats[i] += *p++;
+  h->PutStats(stats);
+  h->SetEntries(entries + *p++);
+  return p;
+}
+
+tree_row::tree_row(TTree* tree): n(0) {
+  const TObjArray *leaves = tree->GetListOfLeaves();
+  for (Int_t i=0, nl=leaves->GetEntries(); i<nl; ++i) {
+    const TLeaf *leaf = static_cast<const TLeaf*>(leaves->At(i));
+    const size_t len = leaf->GetLenType()*leaf->GetLen();
+    fields.emplace_back(static_cast<char*>(leaf->GetValuePointer()), len);
+    n += len;
+  }
+}
+
+void tree_row::save(char* row) const noexcept {
+  for (const auto& f : fields) {
+    memcpy(row, f.first, f.second);
+    row += f.second;
+  }
+}
+
+void tree_row::load(const char* row) const noexcept {
+  for (const auto& f : fields) {
+    memcpy(f.first, row, f.second);
+    row += f.second;
+  }
+}
@@ -0,0 +1,67 @@
+#ifndef workers_hh
+#define workers_hh
+
+#include <vector>
+
+#include <sys/types.h>
+
+#include <Rtypes.h>
+
+class TH1;
+class TTree;
+
+// Forked workers ***************************************************
+// The process forks n workers, which share one anonymous memory
+// region with it. Workers get their own file descriptors for the
+// input files already open, so reads do not share file offsets, and
+// end with done(), which runs no destructors, so nothing of the
+// parent, like the output file, is written by them. Only local files
+// are supported, and no threads may be running when forking.
+
+class workers {
+  unsigned n;
+  char *mem;
+  size_t bytes;
+  std::vector<pid_t> pids;
+
+  static void reopen_inputs();
+
+public:
+  workers(unsigned n, size_t bytes);
+  ~workers();
+
+  // worker number in the workers, -1 in the parent
+  int fork();
+  // in the parent, exits if any worker failed
+  void wait();
+  // in a worker
+  [[noreturn]] static void done();
+
+  unsigned size() const noexcept { return n; }
+  template<typename T> T* data() const noexcept {
+    return reinterpret_cast<T*>(mem);
+  }
+
+  // Contents, errors and statistics of a plain histogram
+  static size_t shared_size(const TH1* h);
+  static Double_t* save(const TH1* h, Double_t* p);
+  static const Double_t* add(TH1* h, const Double_t* p);
+};
+
+// Branch buffers of a tree as rows of bytes ************************
+// A row is filled by a worker, and copied back by the parent
+// before it fills the tree
+
+class tree_row {
+  std::vector<std::pair<char*,size_t>> fields;
+  size_t n;
+
+public:
+  tree_row(TTree* tree);
+
+  size_t size() const noexcept { return n; }
+  void save(char* row) const noexcept;
+  void load(const char* row) const noexcept;
+};
+
+#endif
@@ -0,0 +1,56 @@
+// Submits a job to bhd, e.g.
+// bhc reweigh --bh bh.root -c config.xml -o weights.root
+
+#include <iostream>
+#include <string>
+#include <cstring>
+#include <cerrno>
+
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "job_request.hh"
+
+using namespace std;
+
+int main(int argc, char** argv)
+{
+  if (argc<2) {
+    cout << "Usage: " << argv[0] << " program [options]" << endl;
+    exit(0);
+  }
+
+  job_request req;
+  char cwd[4096];
+  if (!getcwd(cwd, sizeof(cwd))) {
+    cerr << "\033[31mCannot get working directory\033[0m" << endl;
+    exit(1);
+  }
+  req.cwd = cwd;
+  req.args.assign(argv+1, argv+argc);
+  req.out = 1;
+  req.err = 2;
+
+  const string path = job_request::socket_path();
+  sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path)-1);
+
+  const int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (sock < 0 || connect(sock, (sockaddr*)&addr, sizeof(addr))) {
+    cerr << "\033[31mCannot connect to bhd at " << path << ": "
+         << strerror(errno) << "\033[0m" << endl;
+    exit(1);
+  }
+
+  int ret;
+  if (!req.send(sock) || read(sock, &ret, sizeof(ret)) != sizeof(ret)) {
+    cerr << "\033[31mLost connection to bhd\033[0m" << endl;
+    exit(1);
+  }
+  close(sock);
+
+  return ret;
+}
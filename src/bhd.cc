@@ -0,0 +1,209 @@
+// Job server: keeps PDF sets, histogram style files and libraries
+// loaded, and runs reweigh and hist jobs submitted by bhc, each in
+// a forked process
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cerrno>
+
+#include <unistd.h>
+#include <signal.h>
+#include <poll.h>
+#include <dlfcn.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#include <boost/program_options.hpp>
+
+#include <TClass.h>
+
+#include <fastjet/ClusterSequence.hh>
+
+#include "BHEvent.hh"
+#include "rew_calc.hh"
+#include "csshists.hh"
+#include "job_request.hh"
+
+using namespace std;
+namespace po = boost::program_options;
+
+BHEvent event; // extern, also of reweigh jobs
+
+// Job process ******************************************************
+// The job writes to the client's stdout and stderr,
+// in the client's working directory
+[[noreturn]] void run(const job_request& req, const string& jobs_dir) {
+  dup2(req.out, 1);
+  dup2(req.err, 2);
+  close(req.out);
+  close(req.err);
+
+  if (chdir(req.cwd.c_str())) {
+    cerr << "\033[31mbhd: cannot change directory to "
+         << req.cwd << "\033[0m" << endl;
+    exit(1);
+  }
+
+  const string& prog = req.args[0];
+  void *lib = (prog.find('/')==string::npos
+    ? dlopen((jobs_dir+'/'+prog+".so").c_str(), RTLD_NOW) : nullptr);
+  auto job = (lib
+    ? reinterpret_cast<int(*)(int,char**)>(dlsym(lib,"bhd_job")) : nullptr);
+  if (!job) {
+    cerr << "\033[31mbhd: no job " << prog << "\033[0m" << endl;
+    exit(1);
+  }
+
+  vector<char*> argv;
+  for (const auto& a : req.args) argv.push_back(const_cast<char*>(a.c_str()));
+  argv.push_back(nullptr);
+  exit(job(req.args.size(), argv.data()));
+}
+
+// Client session ***************************************************
+// Replies with the exit status of the job,
+// which is stopped if the client goes away
+int session(int sock, const string& jobs_dir) {
+  signal(SIGCHLD, SIG_DFL);
+
+  job_request req;
+  if (!req.recv(sock)) return 1;
+  cout << "Job " << getpid() << ':';
+  for (const auto& a : req.args) cout << ' ' << a;
+  cout << endl;
+
+  const pid_t pid = fork();
+  if (pid < 0) return 1;
+  if (pid == 0) {
+    close(sock);
+    run(req, jobs_dir);
+  }
+  close(req.out);
+  close(req.err);
+
+  int status = 0;
+  for (;;) {
+    if (waitpid(pid, &status, WNOHANG) == pid) break;
+    pollfd p { sock, POLLIN, 0 };
+    char c;
+    if (poll(&p, 1, 200) > 0 && read(sock, &c, 1) <= 0) {
+      kill(pid, SIGTERM);
+      waitpid(pid, &status, 0);
+      break;
+    }
+  }
+  const int ret = (WIFEXITED(status) ? WEXITSTATUS(status)
+                                     : 128+WTERMSIG(status));
+  cout << "Job " << getpid() << " exited with " << ret << endl;
+  return (write(sock, &ret, sizeof(ret)) == sizeof(ret) ? 0 : 1);
+}
+
+// ******************************************************************
+int main(int argc, char** argv)
+{
+  // START OPTIONS **************************************************
+  string socket_path, jobs_dir;
+  vector<string> pdfs, pdf_members, styles;
+
+  try {
+    // General Options ------------------------------------
+    po::options_description desc("Options");
+    desc.add_options()
+      ("help,h", "produce help message")
+      ("socket,s", po::value<string>(&socket_path)
+       ->default_value(job_request::socket_path()),
+       "Unix socket to listen on")
+      ("jobs", po::value<string>(&jobs_dir)
+       ->default_value(JOBSDIR,"lib/bhd"),
+       "directory of the job modules")
+      ("pdf", po::value<vector<string>>(&pdfs),
+       "keep the central member of an LHAPDF set loaded")
+      ("pdf-members", po::value<vector<string>>(&pdf_members),
+       "keep all members of an LHAPDF set loaded,\n"
+       "for PDF uncertainties")
+      ("style", po::value<vector<string>>(&styles),
+       "keep a CSS histogram style file loaded")
+    ;
+
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+    if (vm.count("help")) {
+      cout << desc << endl;
+      return 0;
+    }
+    po::notify(vm);
+  }
+  catch(exception& e) {
+    cerr << "\033[31mError: " <<  e.what() <<"\033[0m"<< endl;
+    exit(1);
+  }
+  // END OPTIONS ****************************************************
+
+  // Load everything jobs share *************************************
+  for (auto& p : pdfs) pdf_set::preload(p);
+  for (auto& p : pdf_members) pdf_set::preload(p,true);
+  for (auto& s : styles) {
+    cout << "Histogram CSS file: " << s << endl;
+    csshists::preload(s);
+  }
+  // dictionaries of the classes read and written by the jobs
+  for (const char* c : {"TChain","TTree","TEntryList","TMemFile",
+                        "TH1D","TH2D","TProfile"}) TClass::GetClass(c);
+  fastjet::ClusterSequence::print_banner();
+
+  // Listen *********************************************************
+  sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (socket_path.size() >= sizeof(addr.sun_path)) {
+    cerr << "\033[31mSocket path is too long: "
+         << socket_path << "\033[0m" << endl;
+    exit(1);
+  }
+  strcpy(addr.sun_path, socket_path.c_str());
+
+  const int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+  unlink(socket_path.c_str());
+  if (sock < 0 || bind(sock, (sockaddr*)&addr, sizeof(addr)) ||
+      chmod(socket_path.c_str(), 0600) || listen(sock, 16)) {
+    cerr << "\033[31mCannot listen on " << socket_path << ": "
+         << strerror(errno) << "\033[0m" << endl;
+    exit(1);
+  }
+  cout << "Listening on " << socket_path << endl;
+
+  signal(SIGCHLD, SIG_IGN); // sessions are not waited for
+  for (;;) {
+    const int c = accept(sock, nullptr, nullptr);
+    if (c < 0) {
+      if (errno == EINTR) continue;
+      cerr << "\033[31maccept: " << strerror(errno) << "\033[0m" << endl;
+      exit(1);
+    }
+
+    // only jobs of the same user
+    ucred cred;
+    socklen_t len = sizeof(cred);
+    if (getsockopt(c, SOL_SOCKET, SO_PEERCRED, &cred, &len) ||
+        cred.uid != getuid()) {
+      cerr << "\033[33mRefused a client of another user\033[0m" << endl;
+      close(c);
+      continue;
+    }
+
+    cout.flush();
+    cerr.flush();
+    const pid_t pid = fork();
+    if (pid == 0) {
+      close(sock);
+      _exit(session(c, jobs_dir));
+    }
+    if (pid < 0)
+      cerr << "\033[33mCannot fork: " << strerror(errno) << "\033[0m" << endl;
+    close(c);
+  }
+}
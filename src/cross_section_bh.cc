@@ -1,43 +1,274 @@
 #include <iostream>
 #include <iomanip>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
 
+#include <glob.h>
+
+#include <boost/program_options.hpp>
+
+#include <TROOT.h>
 #include <TFile.h>
 #include <TTree.h>
+#include <TBranch.h>
+#include <TEntryList.h>
+#include <RVersion.h>
+#if ROOT_VERSION_CODE >= ROOT_VERSION(6,20,0)
+#include <TLeaf.h>
+#include <TObjArray.h>
+#include <TBufferFile.h>
+#include <ROOT/TBulkBranchRead.hxx>
+#endif
 
-#include "BHEvent.hh"
+#include "entry_list.hh"
+#include "eid_index.hh"
 
 using namespace std;
+namespace po = boost::program_options;
 
-int main(int argc, char** argv)
-{
-  if (argc!=2) {
-    cout << "Usage: " << argv[0] << " bh_ntuple.root" << endl;
-    exit(0);
+// Compensated sum **************************************************
+// Neumaier's variant of Kahan summation
+class sum_t {
+  Double_t s = 0., c = 0.;
+public:
+  void operator+=(Double_t x) noexcept {
+    const Double_t t = s + x;
+    if (fabs(s) >= fabs(x)) c += (s - t) + x;
+    else c += (x - t) + s;
+    s = t;
+  }
+  void operator+=(const sum_t& x) noexcept { *this += x.s; *this += x.c; }
+  Double_t operator()() const noexcept { return s + c; }
+};
+
+// Cross section of a sample of events ******************************
+// Entries with the same eid are one event, and the statistical error
+// is computed from event weights
+struct xsec {
+  Long64_t nent = 0, nevt = 0;
+  sum_t w, w2;
+
+  void operator+=(const xsec& x) noexcept {
+    nent += x.nent;
+    nevt += x.nevt;
+    w  += x.w;
+    w2 += x.w2;
+  }
+  Double_t sigma() const noexcept { return w()/nevt; }
+  Double_t error() const noexcept {
+    return sqrt( (w2() - w()*w()/nevt)/(nevt*(nevt-1.)) );
+  }
+};
+
+ostream& operator<<(ostream& os, const xsec& x) {
+  const auto flags = os.flags();
+  os << showpoint << setprecision(6) << x.sigma() << " +- ";
+  if (x.nevt>1) os << x.error();
+  else os << "nan";
+  os << " pb (" << x.nevt << " events, " << x.nent << " entries)";
+  os.flags(flags);
+  return os;
+}
+
+// Sum weights of events ********************************************
+// get(ent,eid,weight) reads entry ent, in order
+template<class Get>
+void sum_events(xsec& x, Get get) {
+  Int_t eid, prev_id = -1;
+  Double_t weight, event_w = 0.;
+  for (Long64_t ent = 0; ent < x.nent; ++ent) {
+    get(ent,eid,weight);
+    if (eid!=prev_id) {
+      if (ent) { x.w += event_w; x.w2 += event_w*event_w; }
+      event_w = 0.;
+      ++x.nevt;
+      prev_id = eid;
+    }
+    event_w += weight;
+  }
+  if (x.nent) { x.w += event_w; x.w2 += event_w*event_w; }
+}
+
+#if ROOT_VERSION_CODE >= ROOT_VERSION(6,20,0)
+// Bulk reads *******************************************************
+// Whole baskets of a branch with one leaf of type T are read at once,
+// without a TBranch::GetEntry call per entry
+template<class T>
+class bulk_branch {
+  TBranch *b;
+  TBufferFile buf;
+  Long64_t first = 0, end = 0; // entries in buf
+
+public:
+  bulk_branch(TBranch* b): b(b), buf(TBuffer::kWrite, 32*1024) { }
+
+  static bool supported(TBranch* b) {
+    const TObjArray *leaves = b->GetListOfLeaves();
+    return leaves->GetEntries()==1 &&
+      static_cast<TLeaf*>(leaves->At(0))->GetLenType()==sizeof(T) &&
+      b->GetBulkRead().SupportsBulkRead();
+  }
+
+  // entries have to be read in order
+  T operator()(Long64_t ent) {
+    if (ent >= end) {
+      const Int_t n = b->GetBulkRead().GetBulkEntries(end, buf);
+      if (n <= 0) {
+        cerr << "\033[31mBulk read of " << b->GetName()
+             << " failed at entry " << end << "\033[0m" << endl;
+        exit(1);
+      }
+      first = end;
+      end += n;
+    }
+    T x;
+    memcpy(&x, buf.GetCurrent() + (ent-first)*sizeof(T), sizeof(T));
+    return x;
   }
+};
+#endif
 
-  TFile *fin  = new TFile(argv[1],"read");
+// Read only id and weight branches of one file *********************
+// With an entry list, weights of other entries are not read,
+// but their events are counted, as are events dropped by skim_bh
+xsec read(const string& file, TEntryList* elist) {
+  TFile *fin = new TFile(file.c_str(),"read");
   if (fin->IsZombie()) exit(1);
   TTree *tree = (TTree*)fin->Get("t3");
+  if (!tree) {
+    cerr << "\033[31mNo tree t3 in " << file << "\033[0m" << endl;
+    exit(1);
+  }
+
+  TBranch *b_id = tree->GetBranch("id");
+  TBranch *b_weight = tree->GetBranch("weight");
+  if (!b_id || !b_weight) {
+    cerr << "\033[31mNo id or weight branch in " << file << "\033[0m" << endl;
+    exit(1);
+  }
+
+  xsec x;
+  x.nent = tree->GetEntries();
+#if ROOT_VERSION_CODE >= ROOT_VERSION(6,20,0)
+  if (!elist && bulk_branch<Int_t>::supported(b_id)
+             && bulk_branch<Double_t>::supported(b_weight)) {
+    bulk_branch<Int_t> ids(b_id);
+    bulk_branch<Double_t> weights(b_weight);
+    sum_events(x, [&](Long64_t ent, Int_t& eid, Double_t& weight){
+      eid = ids(ent);
+      weight = weights(ent);
+    });
+  } else
+#endif
+  {
+    Int_t eid_buf;
+    Double_t weight_buf;
+    b_id->SetAddress(&eid_buf);
+    b_weight->SetAddress(&weight_buf);
+    sum_events(x, [&](Long64_t ent, Int_t& eid, Double_t& weight){
+      b_id->GetEntry(ent);
+      if (!elist || elist->Contains(ent)) b_weight->GetEntry(ent);
+      else weight_buf = 0.;
+      eid = eid_buf;
+      weight = weight_buf;
+    });
+  }
+  x.nevt += dropped_events(fin);
 
-  // BlackHat tree branches
-  BHEvent event;
-  event.SetTree(tree, BHEvent::cross_section);
+  delete fin;
+  return x;
+}
+
+// ******************************************************************
+int main(int argc, char** argv)
+{
+  // START OPTIONS **************************************************
+  vector<string> args;
+  string entries_in;
+  unsigned nthreads;
 
-  Double_t sigma = 0.;
+  try {
+    // General Options ------------------------------------
+    po::options_description desc("Options");
+    desc.add_options()
+      ("help,h", "produce help message")
+      ("bh", po::value<vector<string>>(&args)->required(),
+       "*BlackHat root files or quoted glob patterns")
+      ("threads,j", po::value<unsigned>(&nthreads)
+       ->default_value(thread::hardware_concurrency()),
+       "number of files read at the same time")
+      ("entries", po::value<string>(&entries_in),
+       "sum only the weights of the entries\nof the entry list in this file")
+    ;
 
-  const Long64_t nent = tree->GetEntries();
-  cout << "Entries: " << nent << endl;
-  for (Long64_t ent = 0; ent < nent; ++ent) {
-    tree->GetEntry(ent);
-    sigma += event.weight;
+    po::positional_options_description pos;
+    pos.add("bh",-1);
+
+    po::variables_map vm;
+    po::store(po::command_line_parser(argc, argv)
+      .options(desc).positional(pos).run(), vm);
+    if (argc == 1 || vm.count("help")) {
+      cout << "Usage: " << argv[0] << " bh_ntuple.root ..." << endl;
+      cout << desc << endl;
+      return 0;
+    }
+    po::notify(vm);
+    if (nthreads==0) nthreads = 1;
+  }
+  catch(exception& e) {
+    cerr << "\033[31mError: " <<  e.what() <<"\033[0m"<< endl;
+    exit(1);
   }
-  sigma /= nent;
+  // END OPTIONS ****************************************************
 
-  cout << "Cross section: "
-       << showpoint << setprecision(6) << sigma
-       << " pb" << endl;
+  vector<string> files;
+  for (const auto& arg : args) {
+    if (arg.find_first_of("*?[")!=string::npos) {
+      glob_t g;
+      if (glob(arg.c_str(),0,nullptr,&g)==0)
+        files.insert(files.end(),g.gl_pathv,g.gl_pathv+g.gl_pathc);
+      else cerr << "\033[31mNo files match " << arg << "\033[0m" << endl;
+      globfree(&g);
+    } else files.push_back(arg);
+  }
+  if (files.empty()) exit(1);
 
-  delete fin;
+  // Each file has its own sublist, used by one thread
+  vector<TEntryList*> elists(files.size(), nullptr);
+  if (entries_in.size()) {
+    TEntryList *elist = read_entry_list(entries_in);
+    for (size_t i=0; i<files.size(); ++i)
+      elists[i] = entry_sublist(elist, "t3", files[i].c_str());
+  }
+
+  ROOT::EnableThreadSafety();
+
+  // Files are taken by threads in order, and are reported as they finish
+  vector<xsec> xs(files.size());
+  atomic<size_t> next(0);
+  mutex cout_mutex;
+  vector<thread> threads;
+  for (unsigned t=0, n=min<size_t>(nthreads,files.size()); t<n; ++t)
+    threads.emplace_back([&]{
+      for (size_t i; (i = next++) < files.size(); ) {
+        xs[i] = read(files[i], elists[i]);
+        lock_guard<mutex> lock(cout_mutex);
+        cout << files[i] << ": " << xs[i] << endl;
+      }
+    });
+  for (auto& t : threads) t.join();
+
+  xsec total;
+  for (const auto& x : xs) total += x;
+
+  if (files.size()>1) cout << endl;
+  cout << "Cross section: " << total << endl;
 
   return 0;
 }
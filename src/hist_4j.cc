@@ -1,4 +1,5 @@
 #include <cmath>
+#include <cstring>
 #include <iostream>
 #include <iomanip>
 #include <sstream>
@@ -19,15 +20,27 @@
 #include <TChain.h>
 #include <TDirectory.h>
 #include <TH1.h>
-#include <TLorentzVector.h>
+#include <TEntryList.h>
+#include <TMemFile.h>
 
 #include <fastjet/ClusterSequence.hh>
 
 #include "BHEvent.hh"
 #include "SJClusterAlg.hh"
+#include "small_cluster.hh"
+#include "vec4.hh"
 #include "weight.hh"
+#include "branches.hh"
+#include "tree_cache.hh"
+#include "lockstep.hh"
+#include "eid_index.hh"
+#include "entry_list.hh"
+#include "workers.hh"
+#include "ranks.hh"
 #include "timed_counter.hh"
+#include "prof.hh"
 #include "csshists.hh"
+#include "hist.hh"
 
 #define test(var) \
   cout <<"\033[36m"<< #var <<"\033[0m"<< " = " << var << endl;
@@ -37,32 +50,6 @@ namespace po = boost::program_options;
 
 template<typename T> inline T sq(const T x) { return x*x; }
 
-// Histogram wrapper ************************************************
-class hist {
-  unordered_map<const weight*,TH1*> h;
-public:
-  hist(const string& name) {
-    TH1* hist = css->mkhist(name);
-    hist->Sumw2(false); // in ROOT6 true seems to be the default
-    for (auto& wt : weight::all) {
-      const weight *w = wt.get();
-      dirs[w]->cd();
-      h[w] = static_cast<TH1*>( hist->Clone() );
-    }
-    delete hist;
-  }
-
-  void Fill(Double_t x) noexcept {
-    for (auto& _h : h)
-      _h.second->Fill(x,_h.first->is_float ? _h.first->w.f : _h.first->w.d);
-  }
-
-  static unique_ptr<const csshists> css;
-  static unordered_map<const weight*,TDirectory*> dirs;
-};
-unique_ptr<const csshists> hist::css;
-unordered_map<const weight*,TDirectory*> hist::dirs;
-
 // istream operators ************************************************
 namespace std {
   template<class A, class B>
@@ -101,16 +88,108 @@ fastjet::JetDefinition* JetDef(string& str) {
 // Constants ********************************************************
 constexpr unsigned njets  = 4; // number of jets
 constexpr unsigned n2jets = 6; // number of pairs
+constexpr unsigned n3jets = 12; // number of pairs of pairs sharing a jet
+
+// Jet tables *******************************************************
+// Observables of the leading jets, of every jet pair, and of every two
+// pairs sharing a jet, computed once per event in fixed-size arrays.
+// Pair k of jets i>j is k = i*(i-1)/2 + j, and the pair of the other
+// two jets is n2jets-1-k.
+
+struct jet_table {
+  Double_t px[njets], py[njets], pz[njets], E[njets],
+           pT[njets], rap[njets], phi[njets], eta[njets];
+
+  void set(const vector<vec4>& jets) noexcept {
+    for (size_t i=0;i<njets;++i) {
+      px[i] = jets[i].Px();
+      py[i] = jets[i].Py();
+      pz[i] = jets[i].Pz();
+      E [i] = jets[i].E ();
+      pT[i] = jets[i].Pt();
+      eta[i] = jets[i].Eta();
+    }
+    rapidities(njets,E,pz,rap);
+    azimuths(njets,px,py,phi);
+  }
+};
+
+struct pair_table {
+  Double_t m[n2jets], dphi[n2jets], dy[n2jets], dR[n2jets];
+  Double_t dphi3[n3jets], dy3[n3jets];
+
+  static const unsigned i[n2jets], j[n2jets], a[n3jets], b[n3jets];
+
+  void set(const jet_table& t) noexcept {
+    for (size_t k=0;k<n2jets;++k) {
+      const Double_t
+        E  = t.E [i[k]] + t.E [j[k]], px = t.px[i[k]] + t.px[j[k]],
+        py = t.py[i[k]] + t.py[j[k]], pz = t.pz[i[k]] + t.pz[j[k]],
+        mm = E*E - px*px - py*py - pz*pz;
+      m[k] = copysign(sqrt(fabs(mm)),mm);
+      dphi[k] = fabs(t.phi[i[k]] - t.phi[j[k]]);
+      dy[k] = fabs(t.rap[i[k]] - t.rap[j[k]]);
+      // as in TLorentzVector::DeltaR, with pseudorapidity
+      const Double_t deta = t.eta[i[k]] - t.eta[j[k]];
+      Double_t dphiR = dphi[k];
+      dphiR = dphiR > M_PI ? 2*M_PI - dphiR : dphiR;
+      dR[k] = sqrt( deta*deta + dphiR*dphiR );
+    }
+    for (size_t k=0;k<n3jets;++k) {
+      dphi3[k] = dphi[a[k]] + dphi[b[k]];
+      dy3[k] = dy[a[k]] + dy[b[k]];
+    }
+  }
+};
+
+const unsigned pair_table::i[n2jets] = { 1, 2, 2, 3, 3, 3 };
+const unsigned pair_table::j[n2jets] = { 0, 0, 1, 0, 1, 2 };
+// all pairs of pairs a>b, except a+b == n2jets-1 which share no jet
+const unsigned pair_table::a[n3jets] = { 1, 2, 2, 3, 3, 4, 4, 4, 5, 5, 5, 5 };
+const unsigned pair_table::b[n3jets] = { 0, 0, 1, 0, 1, 0, 2, 3, 1, 2, 3, 4 };
+
+// Branch-free reductions *******************************************
+// Conditional moves rather than jumps, since the comparisons are not
+// predictable from event to event
+
+struct range { Double_t min, max; };
+
+template<size_t N>
+inline range minmax(const Double_t (&x)[N]) noexcept {
+  range r { x[0], x[0] };
+  for (size_t k=1;k<N;++k) {
+    r.min = x[k] < r.min ? x[k] : r.min;
+    r.max = x[k] > r.max ? x[k] : r.max;
+  }
+  return r;
+}
+
+template<size_t N>
+inline size_t argmax(const Double_t (&x)[N]) noexcept {
+  size_t a = 0;
+  for (size_t k=1;k<N;++k) a = x[k] > x[a] ? k : a;
+  return a;
+}
 
 // ******************************************************************
 int main(int argc, char** argv)
 {
+  // Events are split between MPI ranks, if built with make mpi
+  const ranks mpi(argc, argv);
+  if (mpi.rank()) cout.setstate(ios::badbit); // rank 0 reports
+
   // START OPTIONS **************************************************
   vector<string> bh_files, sj_files, wt_files, weights;
-  string output_file, css_file, jet_alg;
+  string output_file, css_file, jet_alg, prof_file;
+  string entries_in, entries_out;
   double pt_cut1, pt_cut4, eta_cut, dR_cut;
   pair<Long64_t,Long64_t> num_ent {0,0};
-  bool counter_newline, quiet;
+  pair<unsigned,unsigned> shard {0,0};
+  bool counter_newline, quiet, profile;
+  Long64_t cache_size;
+  Int_t cache_learn;
+  bool prefetch, check_eid;
+  unsigned nprocs;
 
   bool sj_given = false, wt_given = false;
 
@@ -148,10 +227,33 @@ int main(int argc, char** argv)
        "CSS style file for histogram binning and formating")
       ("num-ent,n", po::value<pair<Long64_t,Long64_t>>(&num_ent),
        "process only this many entries,\nnum or first:num")
+      ("shard", po::value<pair<unsigned,unsigned>>(&shard),
+       "process only shard i of n of the entries, i:n")
+      ("group-events", po::bool_switch(&hist_block::group_events),
+       "combine entries with the same eid before filling,\n"
+       "so that bin errors account for their correlation")
+      ("cache-size", po::value<Long64_t>(&cache_size)->default_value(-1),
+       "TTreeCache size in MB for each input tree,\n0 disables, -1 keeps ROOT's default")
+      ("cache-learn", po::value<Int_t>(&cache_learn)->default_value(0),
+       "entries for the cache learning phase,\n0 caches the branches in use")
+      ("procs,p", po::value<unsigned>(&nprocs)->default_value(1),
+       "number of worker processes, each\nreading a shard of the events")
+      ("prefetch", po::bool_switch(&prefetch),
+       "read baskets asynchronously, and read the next\nfile of each chain in the background")
+      ("check-eid", po::bool_switch(&check_eid),
+       "check that entries of the BH, SJ and weights\nchains have the same event ids")
+      ("entries", po::value<string>(&entries_in),
+       "read only the entries of the entry list\nin this file")
+      ("write-entries", po::value<string>(&entries_out),
+       "write entries that pass the selection\nto an entry list file")
       ("counter-newline", po::bool_switch(&counter_newline),
        "do not overwrite previous counter message")
       ("quiet,q", po::bool_switch(&quiet),
        "Do not print exception messages")
+      ("profile", po::bool_switch(&profile),
+       "print time spent in each stage of the event loop")
+      ("profile-json", po::value<string>(&prof_file),
+       "write profile to a JSON file")
     ;
 
     po::variables_map vm;
@@ -161,12 +263,22 @@ int main(int argc, char** argv)
       return 0;
     }
     po::notify(vm);
+    if (!nprocs)
+      throw runtime_error("Number of processes must be positive");
+    if (nprocs>1 && prefetch)
+      throw runtime_error("--prefetch cannot be used with --procs");
+    if (nprocs>1 && vm.count("write-entries"))
+      throw runtime_error("--write-entries cannot be used with --procs");
+    if (mpi.size()>1 && nprocs>1)
+      throw runtime_error("--procs cannot be used with MPI ranks");
+    if (mpi.size()>1 && vm.count("write-entries"))
+      throw runtime_error("--write-entries cannot be used with MPI ranks");
     if (vm.count("sj")) sj_given = true;
     if (vm.count("wt")) wt_given = true;
   }
   catch(exception& e) {
     cerr << "\033[31mError: " <<  e.what() <<"\033[0m"<< endl;
-    exit(1);
+    mpi.abort(1);
   }
   // END OPTIONS ****************************************************
 
@@ -179,59 +291,105 @@ int main(int argc, char** argv)
   cout << "BH files:" << endl;
   for (auto& f : bh_files) {
     cout << "  " << f << endl;
-    if (!tree->AddFile(f.c_str(),-1) ) exit(1);
+    if (!tree->AddFile(f.c_str(),-1) ) mpi.abort(1);
   }
   if (sj_given) {
     cout << "SJ files:" << endl;
     for (auto& f : sj_files) {
       cout << "  " << f << endl;
-      if (!sj_tree->AddFile(f.c_str(),-1) ) exit(1);
+      if (!sj_tree->AddFile(f.c_str(),-1) ) mpi.abort(1);
     }
   }
   if (wt_given) {
     cout << "Weight files:" << endl;
     for (auto& f : wt_files) {
       cout << "  " << f << endl;
-      if (!wt_tree->AddFile(f.c_str(),-1) ) exit(1);
+      if (!wt_tree->AddFile(f.c_str(),-1) ) mpi.abort(1);
     }
   }
   cout << endl;
 
+  // Ranges of entries are split only between events
+  if (shard.second || num_ent.second>0) {
+    if (shard.second && shard.first>=shard.second) {
+      cerr << "\033[31mNo shard " << shard.first << " of "
+           << shard.second << "\033[0m" << endl;
+      mpi.abort(1);
+    }
+    const eid_index events(tree);
+    if (!events) {
+      cerr << "\033[31mNo id branch in BH chain"
+              " to split entries at events\033[0m" << endl;
+      mpi.abort(1);
+    }
+    const auto range = events.shard(
+      shard.second ? shard.first : 0, shard.second ? shard.second : 1,
+      num_ent.first,
+      num_ent.second>0 ? num_ent.first+num_ent.second : events.entries()
+    );
+    if (range.first==range.second) {
+      cerr << "\033[31mNo events in the range\033[0m" << endl;
+      mpi.abort(1);
+    }
+    num_ent = { range.first, range.second-range.first };
+    cout << "Entries at event boundaries: "
+         << num_ent.first << ':' << num_ent.second << endl << endl;
+  }
+
   // Find number of entries to process
   if (num_ent.second>0) {
     const Long64_t need_ent = num_ent.first + num_ent.second;
     if (need_ent>tree->GetEntries()) {
       cerr << "Fewer entries in BH chain (" << tree->GetEntries()
          << ") then requested (" << need_ent << ')' << endl;
-      exit(1);
+      mpi.abort(1);
     }
     if (sj_given) if (need_ent>sj_tree->GetEntries()) {
       cerr << "Fewer entries in SJ chain (" << sj_tree->GetEntries()
          << ") then requested (" << need_ent << ')' << endl;
-      exit(1);
+      mpi.abort(1);
     }
     if (wt_given) if (need_ent>wt_tree->GetEntries()) {
       cerr << "Fewer entries in weights chain (" << wt_tree->GetEntries()
          << ") then requested (" << need_ent << ')' << endl;
-      exit(1);
+      mpi.abort(1);
     }
   } else {
     num_ent.second = tree->GetEntries();
     if (sj_given) if (num_ent.second!=sj_tree->GetEntries()) {
       cerr << num_ent.second << " entries in BH chain, but "
            << sj_tree->GetEntries() << " entries in SJ chain" << endl;
-      exit(1);
+      mpi.abort(1);
     }
     if (wt_given) if (num_ent.second!=wt_tree->GetEntries()) {
       cerr << num_ent.second << " entries in BH chain, but "
            << wt_tree->GetEntries() << " entries in weights chain" << endl;
-      exit(1);
+      mpi.abort(1);
     }
   }
 
-  // Friend BlackHat tree with SpartyJet and Weight trees
-  if (sj_given) tree->AddFriend(sj_tree,"SJ");
-  if (wt_given) tree->AddFriend(wt_tree,"weights");
+  // Check that entries of all chains are of the same events
+  if (check_eid) {
+    const eid_index bh_eid(tree);
+    for (TChain *chain : {sj_tree, wt_tree}) {
+      if (!chain) continue;
+      const eid_index eid(chain);
+      if (!eid) {
+        cout << "No id branch in " << chain->GetName()
+             << " chain to check" << endl;
+        continue;
+      }
+      const Long64_t ent = bh_eid.mismatch(eid);
+      if (ent >= 0) {
+        cerr << "\033[31mEvent ids in BH and " << chain->GetName()
+             << " chains differ at entry " << ent << "\033[0m" << endl;
+        mpi.abort(1);
+      }
+      cout << chain->GetName() << " chain is aligned with BH chain: "
+           << eid.size() << " events" << endl;
+    }
+    cout << endl;
+  }
 
   // BlackHat tree branches
   BHEvent event;
@@ -239,12 +397,14 @@ int main(int argc, char** argv)
 
   // Jet Clustering Algorithm
   unique_ptr<fastjet::JetDefinition> jet_def;
+  unique_ptr<small_cluster> clust;
   unique_ptr<SJClusterAlg> sj_alg;
 
   if (sj_given) {
-    sj_alg.reset( new SJClusterAlg(tree,jet_alg) );
+    sj_alg.reset( new SJClusterAlg(sj_tree,jet_alg) );
   } else {
     jet_def.reset( JetDef(jet_alg) );
+    clust.reset( new small_cluster(*jet_def) );
     cout << "Clustering with " << jet_def->description() << endl << endl;
   }
 
@@ -254,28 +414,54 @@ int main(int argc, char** argv)
       cout << "Selected weights:" << endl;
       for (auto& w : weights) {
         cout << w << endl;
-        weight::add(tree,w);
+        weight::add(wt_tree,w);
       }
     } else {
       cout << "Using all weights:" << endl;
       const TObjArray *br = wt_tree->GetListOfBranches();
       for (Int_t i=0,n=br->GetEntries();i<n;++i) {
         auto w = br->At(i)->GetName();
+        if (!strcmp(w,"id")) continue; // event id, not a weight
         cout << w << endl;
-        weight::add(tree,w);
+        weight::add(wt_tree,w);
       }
     }
   } else weight::add(tree,"weight",false); // Use default ntuple weight
   cout << endl;
 
+  // Entry lists
+  TEntryList *elist_in = nullptr, *elist_out = nullptr;
+  if (entries_in.size()) {
+    elist_in = read_entry_list(entries_in);
+    set_entry_list(tree, elist_in);
+    cout << "Entry list " << elist_in->GetName() << ": "
+         << elist_in->GetN() << " entries" << endl << endl;
+  }
+  if (entries_out.size()) {
+    elist_out = new TEntryList(("4j_"+jet_alg).c_str(), "");
+    elist_out->SetDirectory(nullptr);
+  }
+
+  // Read only branches in use
+  cout << branches::prune(tree) << endl;
+  if (sj_given) cout << branches::prune(sj_tree) << endl;
+  if (wt_given) cout << branches::prune(wt_tree) << endl;
+  cout << endl;
+  tree_cache cache({tree, sj_tree, wt_tree}, cache_size, cache_learn, prefetch);
+
+  // SpartyJet and weights chains are read in step with the BlackHat chain
+  lockstep reader({tree, sj_tree, wt_tree});
+
   // Read CSS file with histogram properties
   cout << "Histogram CSS file: " << css_file << endl;
   hist::css.reset( new csshists(css_file) );
   cout << endl;
 
   // Open output file with histograms *******************************
-  TFile* fout = new TFile(output_file.c_str(),"recreate");
-  if (fout->IsZombie()) exit(1);
+  // only rank 0 writes the output file
+  TFile* fout = (mpi.rank() ? new TMemFile(output_file.c_str(),"recreate")
+                            : new TFile(output_file.c_str(),"recreate"));
+  if (fout->IsZombie()) mpi.abort(1);
   else cout << "Output file: " << fout->GetName() << endl << endl;
 
   // Make directories ***********************************************
@@ -305,10 +491,6 @@ int main(int argc, char** argv)
 
     h_(jet1_pT), h_(jet2_pT), h_(jet3_pT), h_(jet4_pT),
     h_(4j_HT), h_(2j_HT),
-	h_(2j_HT_250_dy1), h_(2j_HT_400_dy1),h_(2j_HT_550_dy1), h_(2j_HT_700_dy1),
-	h_(2j_HT_250_dy2), h_(2j_HT_400_dy2),h_(2j_HT_550_dy2), h_(2j_HT_700_dy2),
-	h_(2j_HT_250_dy3), h_(2j_HT_400_dy3),h_(2j_HT_550_dy3), h_(2j_HT_700_dy3),
-	h_(2j_HT_250_dy4), h_(2j_HT_400_dy4),h_(2j_HT_550_dy4), h_(2j_HT_700_dy4),
     
     //h_(jet1_y), h_(jet2_y), h_(jet3_y), h_(jet4_y),
 
@@ -331,6 +513,9 @@ int main(int argc, char** argv)
 	h_(3j_deltay_min_400), h_(3j_deltay_min_700), h_(3j_deltay_min_1000)
   ;
 
+  // 2j_HT in slices of leading jet pT and max pair deltay
+  hist_block h_2j_HT_pT_dy("2j_HT_%_dy%");
+
   // Reading entries from the input TChain ***************************
   Long64_t num_selected = 0;
   Int_t prev_id = -1;
@@ -338,21 +523,89 @@ int main(int argc, char** argv)
   if (num_ent.first>0) cout << " starting at " << num_ent.first << endl;
   else cout << endl;
   num_ent.second += num_ent.first;
-  timed_counter counter(counter_newline);
 
-  for (Long64_t ent = num_ent.first; ent < num_ent.second; ++ent) {
+  // Sums of all histograms, for reduction between processes
+  const size_t slot = hist_block::shared_size() + workers::shared_size(h_N)
+                    + workers::shared_size(h_pid) + 1; // and number selected
+  auto save = [&](Double_t* p) {
+    hist_block::commit_all();
+    p = hist_block::save_all(p);
+    p = workers::save(h_N,p);
+    p = workers::save(h_pid,p);
+    *p = num_selected;
+  };
+  auto add = [&](const Double_t* p) {
+    p = hist_block::add_all(p);
+    p = workers::add(h_N,p);
+    p = workers::add(h_pid,p);
+    num_selected += *p++;
+    return p;
+  };
+
+  // Events dropped by skim_bh are counted once, by rank 0
+  const Long64_t num_dropped = (mpi.rank() ? 0
+    : dropped_events(tree, num_ent.first, num_ent.second));
+
+  // Events are split between MPI ranks, or between worker processes
+  // whose histograms are summed by the parent in shared memory
+  unique_ptr<workers> procs;
+  int worker = -1;
+  Long64_t all_first = 0; // of the parent's range
+  if (mpi.size()>1 || nprocs>1) {
+    const eid_index events(tree);
+    if (!events) {
+      cerr << "\033[31mNo id branch in BH chain"
+              " to split events between processes\033[0m" << endl;
+      mpi.abort(1);
+    }
+    if (mpi.size()>1) num_ent = events.shard(
+      mpi.rank(), mpi.size(), num_ent.first, num_ent.second);
+    if (nprocs>1) {
+      procs.reset( new workers(nprocs, nprocs*slot*sizeof(Double_t)) );
+      worker = procs->fork();
+      all_first = num_ent.first;
+      if (worker<0) num_ent.first = num_ent.second; // the parent only sums
+      else {
+        num_ent = events.shard(worker, nprocs, num_ent.first, num_ent.second);
+        if (worker>0) cout.setstate(ios::badbit); // worker 0 shows progress
+      }
+    }
+  }
+
+  timed_counter counter(num_ent.first,num_ent.second,counter_newline);
+
+  // Events without entries in the entry list are counted too
+  if (elist_in) {
+    const eid_index events(tree);
+    for (size_t g=0, n=events.size(); g<n; ++g)
+      if (events[g] < num_ent.second &&
+          (g+1<n ? events[g+1] : events.entries()) > num_ent.first)
+        h_N->Fill(0.5);
+  }
+  if (worker<0 && num_dropped) { // the parent, or the only process
+    h_N->AddBinContent(1,num_dropped);
+    h_N->SetEntries(h_N->GetEntries()+num_dropped);
+  }
+
+  if (profile || prof_file.size()) prof::start();
+
+  entry_loop entries(tree, num_ent.first, num_ent.second);
+  for (Long64_t ent; (ent = entries.next()) >= 0; ) {
     counter(ent);
-    tree->GetEntry(ent);
+    prof::stage(prof::io);
+    reader.GetEntry(ent);
+    prof::stage(prof::fill);
 
     if (event.nparticle>BHMAXNP) {
       cerr << "More particles in the entry then BHMAXNP" << endl
            << "Increase array length to " << event.nparticle << endl;
-      exit(1);
+      mpi.abort(1);
     }
 
     // Count number of events (not entries)
     if (prev_id!=event.eid) {
-      h_N->Fill(0.5);
+      hist_block::commit_all();
+      if (!elist_in) h_N->Fill(0.5);
       ++num_selected;
     }
     prev_id = event.eid;
@@ -361,10 +614,13 @@ int main(int argc, char** argv)
     for (Int_t i=0;i<event.nparticle;i++) h_pid->Fill(event.kf[i]);
 
     // Jet clustering *************************************
-    vector<TLorentzVector> jets;
+    prof::stage(prof::cluster);
+    vector<vec4> jets;
     jets.reserve(njets+1);
     if (sj_given) { // Read jets from SpartyJet ntuple
-      jets = sj_alg->jetsByPt(pt_cut4,eta_cut);
+      static SJjets sj_jets;
+      sj_alg->jetsByPt(sj_jets,pt_cut4,eta_cut,njets); // njets leading are used
+      for (size_t i=0;i<sj_jets.size();++i) jets.push_back(sj_jets[i]);
 
     } else { // Clustered with FastJet on the fly
       vector<fastjet::PseudoJet> particles;
@@ -378,21 +634,22 @@ int main(int argc, char** argv)
       
       // Cluster
       const vector<fastjet::PseudoJet> fj_jets =
-        fastjet::ClusterSequence(particles, *jet_def).inclusive_jets(pt_cut4);
+        clust->inclusive_jets(particles,pt_cut4);
 
-      // Convert to TLorentzVector and apply rapidity cut
+      // Convert to vec4 and apply rapidity cut
       for (auto& j : fj_jets) { //if (j.pt() < pt_cut4) continue;
         if (j.rapidity() > eta_cut) continue;
-        jets.emplace_back(j.px(),j.py(),j.pz(),j.E());
+        jets.push_back(vec4::pseudojet(j));
       }
       
       // Sort by pT in descending order
       std::sort( jets.begin(), jets.end(),
-        [](const TLorentzVector& i, const TLorentzVector& j)
+        [](const vec4& i, const vec4& j)
           { return i.Pt() > j.Pt(); }
       );
     }
     const size_t this_njets = jets.size(); // number of jets
+    prof::stage(prof::fill);
 
     // ****************************************************
    	
@@ -403,18 +660,16 @@ int main(int argc, char** argv)
     if (jets.front().Pt()<pt_cut1) continue;
     if (jets[3].Pt()<pt_cut4) continue;
 
+    // Jet and pair tables *******************************
+    static jet_table jt;
+    static pair_table pt;
+    jt.set(jets);
+    pt.set(jt);
+
 	// Get the minimum dR between two jets
-	double minDRij = 999;
-    double dRij = 0;
-    for (unsigned int iJet=0; iJet<4; iJet++){
-        for (unsigned int jJet=iJet+1; jJet<4; jJet++){
-            dRij = fabs(jets[iJet].DeltaR(jets[jJet]));
-            if (dRij < minDRij){
-                minDRij = dRij;
-            }
-        }
-    }
-	if (minDRij < dR_cut) continue;
+	if (minmax(pt.dR).min < dR_cut) continue;
+
+    if (elist_out) elist_out->Enter(ent,tree);
 	
 
     // Number of jets hists *******************************
@@ -424,13 +679,9 @@ int main(int argc, char** argv)
 
 
     // Jets pT ********************************************
-    static array<double,njets> pT, rap, phi;
+    const Double_t *pT = jt.pT;
     Double_t HT = 0.;
-    for (size_t i=0;i<jets.size();++i) {
-      HT += pT[i] = jets[i].Pt();
-      rap[i] = jets[i].Rapidity();
-      phi[i] = jets[i].Phi();
-    }
+    for (size_t i=0;i<jets.size();++i) HT += jets[i].Pt();
 
     h_4j_HT.Fill(HT);
     h_jet1_pT.Fill(pT[0]);
@@ -438,65 +689,26 @@ int main(int argc, char** argv)
     h_jet3_pT.Fill(pT[2]);
     h_jet4_pT.Fill(pT[3]);
     
-    //h_jet1_y.Fill(rap[0]);
-    //h_jet2_y.Fill(rap[1]);
-    //h_jet3_y.Fill(rap[2]);
-    //h_jet4_y.Fill(rap[3]);
+    //h_jet1_y.Fill(jt.rap[0]);
+    //h_jet2_y.Fill(jt.rap[1]);
+    //h_jet3_y.Fill(jt.rap[2]);
+    //h_jet4_y.Fill(jt.rap[3]);
 
     // Sum of all jets ************************************
-    const TLorentzVector all4 = jets[0] + jets[1] + jets[2] + jets[3];
+    const vec4 all4 = jets[0] + jets[1] + jets[2] + jets[3];
     const Double_t m4 = all4.M();
     
     h_4j_mass.Fill(m4);
     
     // Jet pairs ******************************************
-    static array<double,n2jets> dphi2_, dy2_;
-    
-    Double_t    m2_min =             (jets[0]+jets[1]).M();
-    Double_t dphi2_min = dphi2_[0] = fabs(phi[0] - phi[1]);
-    Double_t   dy2_min =   dy2_[0] = fabs(rap[0] - rap[1]);
-    Double_t    m2_max =    m2_min;
-    Double_t dphi2_max = dphi2_min;
-    Double_t   dy2_max =   dy2_min;
-    
-    // To flatten traceless triangular matrix:
-    // k = i*(i-1)/2 + j
-    
-	size_t non_central_i=0;
-	size_t non_central_j=1;
-	size_t central_i=0;
-	size_t central_j=1;
-    for (size_t i=2,k=1;i<njets;++i) {
-      for (size_t j=0;j<i;++j,++k) {
-        const Double_t    m2 =             (jets[i]+jets[j]).M();
-        const Double_t dphi2 = dphi2_[k] = fabs(phi[i] - phi[j]);
-        const Double_t   dy2 =   dy2_[k] = fabs(rap[i] - rap[j]);
-        if (   m2 <    m2_min)    m2_min =    m2;
-        if (   m2 >    m2_max)    m2_max =    m2;
-        if (dphi2 < dphi2_min) dphi2_min = dphi2;
-        if (dphi2 > dphi2_max) dphi2_max = dphi2;
-        if (  dy2 <   dy2_min)   dy2_min =   dy2;
-        if (  dy2 >   dy2_max)   { 
-			dy2_max =   dy2;
-			non_central_i = i;
-			non_central_j = j;
-		}
-      }
-    }
-	// find two central jets
-    for (size_t i=0;i<njets;++i) {
-	  if ( i != non_central_i && i != non_central_j) {
-		central_i = i;
-		break;
-	  }
-	}
-    for (size_t i=0;i<njets;++i) {
-	  if ( i != non_central_i && i != non_central_j && i != central_j) {
-		central_j = i;
-		break;
-	  }
-	}
-	double Ht_2j = jets[central_i].Pt() + jets[central_j].Pt();
+    const range m2 = minmax(pt.m), dphi2 = minmax(pt.dphi), dy2 = minmax(pt.dy);
+    const Double_t    m2_min =    m2.min,    m2_max =    m2.max;
+    const Double_t dphi2_min = dphi2.min, dphi2_max = dphi2.max;
+    const Double_t   dy2_min =   dy2.min,   dy2_max =   dy2.max;
+
+	// two central jets are the pair other than the one with largest dy
+	const size_t central = n2jets-1-argmax(pt.dy);
+	double Ht_2j = pT[pair_table::i[central]] + pT[pair_table::j[central]];
 
     h_2j_mass_min    .Fill(   m2_min/m4 );
 	if (m4>500) h_2j_mass_min_500 .Fill( m2_min/m4);
@@ -509,37 +721,22 @@ int main(int argc, char** argv)
     h_2j_deltay_min  .Fill(  dy2_min);
     h_2j_deltay_max  .Fill(  dy2_max);
 	h_2j_HT			 .Fill(  Ht_2j	);
+    h_2j_HT_pT_dy    .Fill(  Ht_2j, jets[0].Pt(), dy2_max );
 	if (jets[0].Pt()> 250) 	{
       h_2j_deltay_max_250  .Fill(  dy2_max);
-	  if (dy2_max > 1) h_2j_HT_250_dy1	 	   .Fill(  Ht_2j  );
-	  if (dy2_max > 2) h_2j_HT_250_dy2	 	   .Fill(  Ht_2j  );
-	  if (dy2_max > 3) h_2j_HT_250_dy3	 	   .Fill(  Ht_2j  );
-	  if (dy2_max > 4) h_2j_HT_250_dy4	 	   .Fill(  Ht_2j  );
 	}
 	if (jets[0].Pt()> 400) 	{
 	  h_2j_deltaphi_min_400.Fill(dphi2_min);
       h_2j_deltay_min_400  .Fill(  dy2_min);
       h_2j_deltay_max_400  .Fill(  dy2_max);
-	  if (dy2_max > 1) h_2j_HT_400_dy1	 	   .Fill(  Ht_2j  );
-	  if (dy2_max > 2) h_2j_HT_400_dy2	 	   .Fill(  Ht_2j  );
-	  if (dy2_max > 3) h_2j_HT_400_dy3	 	   .Fill(  Ht_2j  );
-	  if (dy2_max > 4) h_2j_HT_400_dy4	 	   .Fill(  Ht_2j  );
 	}
 	if (jets[0].Pt()> 550) 	{
       h_2j_deltay_max_550  .Fill(  dy2_max);
-	  if (dy2_max > 1) h_2j_HT_550_dy1	 	   .Fill(  Ht_2j  );
-	  if (dy2_max > 2) h_2j_HT_550_dy2	 	   .Fill(  Ht_2j  );
-	  if (dy2_max > 3) h_2j_HT_550_dy3	 	   .Fill(  Ht_2j  );
-	  if (dy2_max > 4) h_2j_HT_550_dy4	 	   .Fill(  Ht_2j  );
 	}
 	if (jets[0].Pt()> 700) 	{
 	  h_2j_deltaphi_min_700.Fill(dphi2_min);
       h_2j_deltay_min_700  .Fill(  dy2_min);
       h_2j_deltay_max_700  .Fill(  dy2_max);
-	  if (dy2_max > 1) h_2j_HT_700_dy1	 	   .Fill(  Ht_2j  );
-	  if (dy2_max > 2) h_2j_HT_700_dy2	 	   .Fill(  Ht_2j  );
-	  if (dy2_max > 3) h_2j_HT_700_dy3	 	   .Fill(  Ht_2j  );
-	  if (dy2_max > 4) h_2j_HT_700_dy4	 	   .Fill(  Ht_2j  );
 	}
 	if (jets[0].Pt()> 1000) {
 	  h_2j_deltaphi_min_1000.Fill(dphi2_min);
@@ -547,24 +744,9 @@ int main(int argc, char** argv)
 	}
 
     // Jet triplets ***************************************
-    Double_t dphi3_min = dphi2_[0] + dphi2_[1];
-    Double_t   dy3_min =   dy2_[0] +   dy2_[1];
-    Double_t dphi3_max = dphi3_min;
-    Double_t   dy3_max =   dy3_min;
-    
-    for (size_t i=2;i<n2jets;++i) {
-      for (size_t j=0;j<i;++j) {
-        if (i+j == n2jets-1) continue;
-
-        const Double_t dphi3 = dphi2_[i] + dphi2_[j];
-        const Double_t   dy3 =   dy2_[i] +   dy2_[j];
-        
-        if (dphi3 < dphi3_min) dphi3_min = dphi3;
-        if (dphi3 > dphi3_max) dphi3_max = dphi3;
-        if (  dy3 <   dy3_min)   dy3_min =   dy3;
-        if (  dy3 >   dy3_max)   dy3_max =   dy3;
-      }
-    }
+    const range dphi3 = minmax(pt.dphi3), dy3 = minmax(pt.dy3);
+    const Double_t dphi3_min = dphi3.min, dphi3_max = dphi3.max;
+    const Double_t   dy3_min =   dy3.min,   dy3_max =   dy3.max;
     
     h_3j_deltaphi_min.Fill(dphi3_min);
     h_3j_deltaphi_max.Fill(dphi3_max);
@@ -593,17 +775,50 @@ int main(int argc, char** argv)
 
   } // END of event loop
 
-  counter.prt(num_ent.second);
+  if (worker>=0) {
+    counter.prt(num_ent.second);
+    save(procs->data<Double_t>() + worker*slot);
+    workers::done();
+  }
+  if (procs) {
+    procs->wait();
+    const Double_t *p = procs->data<Double_t>();
+    for (unsigned i=0; i<nprocs; ++i) p = add(p);
+    num_ent = { all_first, num_ent.second };
+    cout << nprocs << " workers done" << endl;
+  } else counter.prt(num_ent.second);
+  if (mpi.size()>1) {
+    // rank 0 adds the sums of the other ranks to its own
+    vector<Double_t> buf(slot,0.);
+    if (mpi.rank()) save(buf.data());
+    mpi.sum(buf.data(), buf.size());
+    if (mpi.rank()) return 0;
+    add(buf.data());
+    cout << mpi.size() << " MPI ranks done" << endl;
+  }
   cout << endl;
   cout << "Selected events: " << num_selected << endl;
+  cache.report(cout);
+  if (elist_out) {
+    write_entry_list(elist_out, entries_out);
+    cout << "Entry list " << elist_out->GetName() << ": "
+         << elist_out->GetN() << " entries written to "
+         << entries_out << endl;
+  }
 
   // Close files
+  prof::stage(prof::write);
+  hist_block::write_all();
   fout->Write();
   fout->Close();
   delete fout;
   delete tree;
   delete sj_tree;
   delete wt_tree;
+  prof::stage(prof::other);
+
+  if (profile) prof::prt(cout, num_ent.second-num_ent.first);
+  if (prof_file.size()) prof::json(prof_file, num_ent.second-num_ent.first);
 
   return 0;
 }
@@ -1,4 +1,5 @@
 #include <cmath>
+#include <cstring>
 #include <iostream>
 #include <iomanip>
 #include <sstream>
@@ -18,15 +19,27 @@
 #include <TChain.h>
 #include <TDirectory.h>
 #include <TH1.h>
-#include <TLorentzVector.h>
+#include <TEntryList.h>
+#include <TMemFile.h>
 
 #include <fastjet/ClusterSequence.hh>
 
 #include "BHEvent.hh"
 #include "SJClusterAlg.hh"
+#include "small_cluster.hh"
+#include "vec4.hh"
 #include "weight.hh"
+#include "branches.hh"
+#include "tree_cache.hh"
+#include "lockstep.hh"
+#include "eid_index.hh"
+#include "entry_list.hh"
+#include "workers.hh"
+#include "ranks.hh"
 #include "timed_counter.hh"
+#include "prof.hh"
 #include "csshists.hh"
+#include "hist.hh"
 
 #define test(var) \
   cout <<"\033[36m"<< #var <<"\033[0m"<< " = " << var << endl;
@@ -36,32 +49,6 @@ namespace po = boost::program_options;
 
 template<typename T> inline T sq(const T x) { return x*x; }
 
-// Histogram wrapper ************************************************
-class hist {
-  unordered_map<const weight*,TH1*> h;
-public:
-  hist(const string& name) {
-    TH1* hist = css->mkhist(name);
-    hist->Sumw2(false); // in ROOT6 true seems to be the default
-    for (auto& wt : weight::all) {
-      const weight *w = wt.get();
-      dirs[w]->cd();
-      h[w] = static_cast<TH1*>( hist->Clone() );
-    }
-    delete hist;
-  }
-
-  void Fill(Double_t x) noexcept {
-    for (auto& _h : h)
-      _h.second->Fill(x,_h.first->is_float ? _h.first->w.f : _h.first->w.d);
-  }
-
-  static unique_ptr<const csshists> css;
-  static unordered_map<const weight*,TDirectory*> dirs;
-};
-unique_ptr<const csshists> hist::css;
-unordered_map<const weight*,TDirectory*> hist::dirs;
-
 // istream operators ************************************************
 namespace std {
   template<class A, class B>
@@ -106,28 +93,34 @@ private:
     return sqrt( pT*pT + mass*mass )/( 2.*cosh(y - Y) );
   }
 public:
-  TLorentzVector *p;
+  vec4 p;
   Double_t mass, pT, y, tau;
-  Jet(const TLorentzVector& p, Double_t Y, bool keep=false) noexcept
-  : p(keep ? new TLorentzVector(p) : nullptr),
-    mass(p.M()), pT(p.Pt()), y(p.Rapidity()), tau(_tau(Y))
-  { }
-  Jet(const fastjet::PseudoJet& p, Double_t Y, bool keep=false) noexcept
-  : p(keep ? new TLorentzVector(p.px(),p.py(),p.pz(),p.E()) : nullptr),
-    mass(p.m()), pT(sqrt(p.kt2())), y(p.rapidity()), tau(_tau(Y))
+  Jet(const vec4& p, Double_t Y) noexcept
+  : p(p), mass(p.M()), pT(p.Pt()), y(p.Rapidity()), tau(_tau(Y))
   { }
-  ~Jet() { delete p; }
 };
 
 // ******************************************************************
 int main(int argc, char** argv)
 {
+  // Events are split between MPI ranks, if built with make mpi
+  const ranks mpi(argc, argv);
+  if (mpi.rank()) cout.setstate(ios::badbit); // rank 0 reports
+
   // START OPTIONS **************************************************
   vector<string> bh_files, sj_files, wt_files, weights;
-  string output_file, css_file, jet_alg;
+  string output_file, css_file, jet_alg, prof_file;
+  string entries_in, entries_out;
+  unsigned entries_njets;
+  bool entries_vbf;
   double pt_cut, eta_cut;
   pair<Long64_t,Long64_t> num_ent {0,0};
-  bool counter_newline, quiet;
+  pair<unsigned,unsigned> shard {0,0};
+  bool counter_newline, quiet, profile;
+  Long64_t cache_size;
+  Int_t cache_learn;
+  bool prefetch, check_eid;
+  unsigned nprocs;
 
   bool sj_given = false, wt_given = false;
 
@@ -161,10 +154,37 @@ int main(int argc, char** argv)
        "CSS style file for histogram binning and formating")
       ("num-ent,n", po::value<pair<Long64_t,Long64_t>>(&num_ent),
        "process only this many entries,\nnum or first:num")
+      ("shard", po::value<pair<unsigned,unsigned>>(&shard),
+       "process only shard i of n of the entries, i:n")
+      ("group-events", po::bool_switch(&hist_block::group_events),
+       "combine entries with the same eid before filling,\n"
+       "so that bin errors account for their correlation")
+      ("cache-size", po::value<Long64_t>(&cache_size)->default_value(-1),
+       "TTreeCache size in MB for each input tree,\n0 disables, -1 keeps ROOT's default")
+      ("cache-learn", po::value<Int_t>(&cache_learn)->default_value(0),
+       "entries for the cache learning phase,\n0 caches the branches in use")
+      ("procs,p", po::value<unsigned>(&nprocs)->default_value(1),
+       "number of worker processes, each\nreading a shard of the events")
+      ("prefetch", po::bool_switch(&prefetch),
+       "read baskets asynchronously, and read the next\nfile of each chain in the background")
+      ("check-eid", po::bool_switch(&check_eid),
+       "check that entries of the BH, SJ and weights\nchains have the same event ids")
+      ("entries", po::value<string>(&entries_in),
+       "read only the entries of the entry list\nin this file")
+      ("write-entries", po::value<string>(&entries_out),
+       "write entries that pass the selection\nto an entry list file")
+      ("entries-njets", po::value<unsigned>(&entries_njets)->default_value(2),
+       "minimum number of jets of written entries")
+      ("entries-vbf", po::bool_switch(&entries_vbf),
+       "written entries also pass loose VBF cuts")
       ("counter-newline", po::bool_switch(&counter_newline),
        "do not overwrite previous counter message")
       ("quiet,q", po::bool_switch(&quiet),
        "Do not print exception messages")
+      ("profile", po::bool_switch(&profile),
+       "print time spent in each stage of the event loop")
+      ("profile-json", po::value<string>(&prof_file),
+       "write profile to a JSON file")
     ;
 
     po::variables_map vm;
@@ -174,12 +194,22 @@ int main(int argc, char** argv)
       return 0;
     }
     po::notify(vm);
+    if (!nprocs)
+      throw runtime_error("Number of processes must be positive");
+    if (nprocs>1 && prefetch)
+      throw runtime_error("--prefetch cannot be used with --procs");
+    if (nprocs>1 && vm.count("write-entries"))
+      throw runtime_error("--write-entries cannot be used with --procs");
+    if (mpi.size()>1 && nprocs>1)
+      throw runtime_error("--procs cannot be used with MPI ranks");
+    if (mpi.size()>1 && vm.count("write-entries"))
+      throw runtime_error("--write-entries cannot be used with MPI ranks");
     if (vm.count("sj")) sj_given = true;
     if (vm.count("wt")) wt_given = true;
   }
   catch(exception& e) {
     cerr << "\033[31mError: " <<  e.what() <<"\033[0m"<< endl;
-    exit(1);
+    mpi.abort(1);
   }
   // END OPTIONS ****************************************************
 
@@ -192,59 +222,105 @@ int main(int argc, char** argv)
   cout << "BH files:" << endl;
   for (auto& f : bh_files) {
     cout << "  " << f << endl;
-    if (!tree->AddFile(f.c_str(),-1) ) exit(1);
+    if (!tree->AddFile(f.c_str(),-1) ) mpi.abort(1);
   }
   if (sj_given) {
     cout << "SJ files:" << endl;
     for (auto& f : sj_files) {
       cout << "  " << f << endl;
-      if (!sj_tree->AddFile(f.c_str(),-1) ) exit(1);
+      if (!sj_tree->AddFile(f.c_str(),-1) ) mpi.abort(1);
     }
   }
   if (wt_given) {
     cout << "Weight files:" << endl;
     for (auto& f : wt_files) {
       cout << "  " << f << endl;
-      if (!wt_tree->AddFile(f.c_str(),-1) ) exit(1);
+      if (!wt_tree->AddFile(f.c_str(),-1) ) mpi.abort(1);
     }
   }
   cout << endl;
 
+  // Ranges of entries are split only between events
+  if (shard.second || num_ent.second>0) {
+    if (shard.second && shard.first>=shard.second) {
+      cerr << "\033[31mNo shard " << shard.first << " of "
+           << shard.second << "\033[0m" << endl;
+      mpi.abort(1);
+    }
+    const eid_index events(tree);
+    if (!events) {
+      cerr << "\033[31mNo id branch in BH chain"
+              " to split entries at events\033[0m" << endl;
+      mpi.abort(1);
+    }
+    const auto range = events.shard(
+      shard.second ? shard.first : 0, shard.second ? shard.second : 1,
+      num_ent.first,
+      num_ent.second>0 ? num_ent.first+num_ent.second : events.entries()
+    );
+    if (range.first==range.second) {
+      cerr << "\033[31mNo events in the range\033[0m" << endl;
+      mpi.abort(1);
+    }
+    num_ent = { range.first, range.second-range.first };
+    cout << "Entries at event boundaries: "
+         << num_ent.first << ':' << num_ent.second << endl << endl;
+  }
+
   // Find number of entries to process
   if (num_ent.second>0) {
     const Long64_t need_ent = num_ent.first + num_ent.second;
     if (need_ent>tree->GetEntries()) {
       cerr << "Fewer entries in BH chain (" << tree->GetEntries()
          << ") then requested (" << need_ent << ')' << endl;
-      exit(1);
+      mpi.abort(1);
     }
     if (sj_given) if (need_ent>sj_tree->GetEntries()) {
       cerr << "Fewer entries in SJ chain (" << sj_tree->GetEntries()
          << ") then requested (" << need_ent << ')' << endl;
-      exit(1);
+      mpi.abort(1);
     }
     if (wt_given) if (need_ent>wt_tree->GetEntries()) {
       cerr << "Fewer entries in weights chain (" << wt_tree->GetEntries()
          << ") then requested (" << need_ent << ')' << endl;
-      exit(1);
+      mpi.abort(1);
     }
   } else {
     num_ent.second = tree->GetEntries();
     if (sj_given) if (num_ent.second!=sj_tree->GetEntries()) {
       cerr << num_ent.second << " entries in BH chain, but "
            << sj_tree->GetEntries() << " entries in SJ chain" << endl;
-      exit(1);
+      mpi.abort(1);
     }
     if (wt_given) if (num_ent.second!=wt_tree->GetEntries()) {
       cerr << num_ent.second << " entries in BH chain, but "
            << wt_tree->GetEntries() << " entries in weights chain" << endl;
-      exit(1);
+      mpi.abort(1);
     }
   }
 
-  // Friend BlackHat tree with SpartyJet and Weight trees
-  if (sj_given) tree->AddFriend(sj_tree,"SJ");
-  if (wt_given) tree->AddFriend(wt_tree,"weights");
+  // Check that entries of all chains are of the same events
+  if (check_eid) {
+    const eid_index bh_eid(tree);
+    for (TChain *chain : {sj_tree, wt_tree}) {
+      if (!chain) continue;
+      const eid_index eid(chain);
+      if (!eid) {
+        cout << "No id branch in " << chain->GetName()
+             << " chain to check" << endl;
+        continue;
+      }
+      const Long64_t ent = bh_eid.mismatch(eid);
+      if (ent >= 0) {
+        cerr << "\033[31mEvent ids in BH and " << chain->GetName()
+             << " chains differ at entry " << ent << "\033[0m" << endl;
+        mpi.abort(1);
+      }
+      cout << chain->GetName() << " chain is aligned with BH chain: "
+           << eid.size() << " events" << endl;
+    }
+    cout << endl;
+  }
 
   // BlackHat tree branches
   BHEvent event;
@@ -252,12 +328,14 @@ int main(int argc, char** argv)
 
   // Jet Clustering Algorithm
   unique_ptr<fastjet::JetDefinition> jet_def;
+  unique_ptr<small_cluster> clust;
   unique_ptr<SJClusterAlg> sj_alg;
 
   if (sj_given) {
-    sj_alg.reset( new SJClusterAlg(tree,jet_alg) );
+    sj_alg.reset( new SJClusterAlg(sj_tree,jet_alg) );
   } else {
     jet_def.reset( JetDef(jet_alg) );
+    clust.reset( new small_cluster(*jet_def) );
     cout << "Clustering with " << jet_def->description() << endl << endl;
   }
 
@@ -267,28 +345,54 @@ int main(int argc, char** argv)
       cout << "Selected weights:" << endl;
       for (auto& w : weights) {
         cout << w << endl;
-        weight::add(tree,w);
+        weight::add(wt_tree,w);
       }
     } else {
       cout << "Using all weights:" << endl;
       const TObjArray *br = wt_tree->GetListOfBranches();
       for (Int_t i=0,n=br->GetEntries();i<n;++i) {
         auto w = br->At(i)->GetName();
+        if (!strcmp(w,"id")) continue; // event id, not a weight
         cout << w << endl;
-        weight::add(tree,w);
+        weight::add(wt_tree,w);
       }
     }
   } else weight::add(tree,"weight",false); // Use default ntuple weight
   cout << endl;
 
+  // Entry lists
+  TEntryList *elist_in = nullptr, *elist_out = nullptr;
+  if (entries_in.size()) {
+    elist_in = read_entry_list(entries_in);
+    set_entry_list(tree, elist_in);
+    cout << "Entry list " << elist_in->GetName() << ": "
+         << elist_in->GetN() << " entries" << endl << endl;
+  }
+  if (entries_out.size()) {
+    elist_out = new TEntryList(("H2j_"+jet_alg+"_"+to_string(entries_njets)+"j"+(entries_vbf ? "_VBF" : "")).c_str(), "");
+    elist_out->SetDirectory(nullptr);
+  }
+
+  // Read only branches in use
+  cout << branches::prune(tree) << endl;
+  if (sj_given) cout << branches::prune(sj_tree) << endl;
+  if (wt_given) cout << branches::prune(wt_tree) << endl;
+  cout << endl;
+  tree_cache cache({tree, sj_tree, wt_tree}, cache_size, cache_learn, prefetch);
+
+  // SpartyJet and weights chains are read in step with the BlackHat chain
+  lockstep reader({tree, sj_tree, wt_tree});
+
   // Read CSS file with histogram properties
   cout << "Histogram CSS file: " << css_file << endl;
   hist::css.reset( new csshists(css_file) );
   cout << endl;
 
   // Open output file with histograms *******************************
-  TFile* fout = new TFile(output_file.c_str(),"recreate");
-  if (fout->IsZombie()) exit(1);
+  // only rank 0 writes the output file
+  TFile* fout = (mpi.rank() ? new TMemFile(output_file.c_str(),"recreate")
+                            : new TFile(output_file.c_str(),"recreate"));
+  if (fout->IsZombie()) mpi.abort(1);
   else cout << "Output file: " << fout->GetName() << endl << endl;
 
   // Make directories ***********************************************
@@ -358,16 +462,83 @@ int main(int argc, char** argv)
   if (num_ent.first>0) cout << " starting at " << num_ent.first << endl;
   else cout << endl;
   num_ent.second += num_ent.first;
-  timed_counter counter(counter_newline);
 
-  for (Long64_t ent = num_ent.first; ent < num_ent.second; ++ent) {
+  // Sums of all histograms, for reduction between processes
+  const size_t slot = hist_block::shared_size() + workers::shared_size(h_N)
+                    + workers::shared_size(h_pid) + 1; // and number selected
+  auto save = [&](Double_t* p) {
+    hist_block::commit_all();
+    p = hist_block::save_all(p);
+    p = workers::save(h_N,p);
+    p = workers::save(h_pid,p);
+    *p = num_selected;
+  };
+  auto add = [&](const Double_t* p) {
+    p = hist_block::add_all(p);
+    p = workers::add(h_N,p);
+    p = workers::add(h_pid,p);
+    num_selected += *p++;
+    return p;
+  };
+
+  // Events dropped by skim_bh are counted once, by rank 0
+  const Long64_t num_dropped = (mpi.rank() ? 0
+    : dropped_events(tree, num_ent.first, num_ent.second));
+
+  // Events are split between MPI ranks, or between worker processes
+  // whose histograms are summed by the parent in shared memory
+  unique_ptr<workers> procs;
+  int worker = -1;
+  Long64_t all_first = 0; // of the parent's range
+  if (mpi.size()>1 || nprocs>1) {
+    const eid_index events(tree);
+    if (!events) {
+      cerr << "\033[31mNo id branch in BH chain"
+              " to split events between processes\033[0m" << endl;
+      mpi.abort(1);
+    }
+    if (mpi.size()>1) num_ent = events.shard(
+      mpi.rank(), mpi.size(), num_ent.first, num_ent.second);
+    if (nprocs>1) {
+      procs.reset( new workers(nprocs, nprocs*slot*sizeof(Double_t)) );
+      worker = procs->fork();
+      all_first = num_ent.first;
+      if (worker<0) num_ent.first = num_ent.second; // the parent only sums
+      else {
+        num_ent = events.shard(worker, nprocs, num_ent.first, num_ent.second);
+        if (worker>0) cout.setstate(ios::badbit); // worker 0 shows progress
+      }
+    }
+  }
+
+  timed_counter counter(num_ent.first,num_ent.second,counter_newline);
+
+  // Events without entries in the entry list are counted too
+  if (elist_in) {
+    const eid_index events(tree);
+    for (size_t g=0, n=events.size(); g<n; ++g)
+      if (events[g] < num_ent.second &&
+          (g+1<n ? events[g+1] : events.entries()) > num_ent.first)
+        h_N->Fill(0.5);
+  }
+  if (worker<0 && num_dropped) { // the parent, or the only process
+    h_N->AddBinContent(1,num_dropped);
+    h_N->SetEntries(h_N->GetEntries()+num_dropped);
+  }
+
+  if (profile || prof_file.size()) prof::start();
+
+  entry_loop entries(tree, num_ent.first, num_ent.second);
+  for (Long64_t ent; (ent = entries.next()) >= 0; ) {
     counter(ent);
-    tree->GetEntry(ent);
+    prof::stage(prof::io);
+    reader.GetEntry(ent);
+    prof::stage(prof::fill);
 
     if (event.nparticle>BHMAXNP) {
       cerr << "More particles in the entry then BHMAXNP" << endl
            << "Increase array length to " << event.nparticle << endl;
-      exit(1);
+      mpi.abort(1);
     }
 
     // Find Higgs
@@ -383,13 +554,14 @@ int main(int argc, char** argv)
 
     // Count number of events (not entries)
     if (prev_id!=event.eid) {
-      h_N->Fill(0.5);
+      hist_block::commit_all();
+      if (!elist_in) h_N->Fill(0.5);
       ++num_selected;
     }
     prev_id = event.eid;
 
     // Higgs 4-vector
-    const TLorentzVector higgs(event.px[hi],event.py[hi],event.pz[hi],event.E[hi]);
+    const vec4 higgs(event.px[hi],event.py[hi],event.pz[hi],event.E[hi]);
 
     const Double_t H_mass = higgs.M();        // Higgs Mass
     const Double_t H_pT   = higgs.Pt();       // Higgs Pt
@@ -403,12 +575,14 @@ int main(int argc, char** argv)
     h_H_y_0j .Fill(H_y);
 
     // Jet clustering *************************************
+    prof::stage(prof::cluster);
     vector<Jet> jets;
     if (sj_given) { // Read jets from SpartyJet ntuple
-      const vector<TLorentzVector> sj_jets = sj_alg->jetsByPt(pt_cut,eta_cut);
+      static SJjets sj_jets;
+      sj_alg->jetsByPt(sj_jets,pt_cut,eta_cut,2); // only 2 leading are used
       jets.reserve(sj_jets.size());
-      for (auto& jet : sj_jets) {
-        jets.emplace_back(jet,H_y,jets.size()<2);
+      for (size_t i=0;i<sj_jets.size();++i) {
+        jets.emplace_back(sj_jets[i],H_y);
       }
 
     } else { // Clusted with FastJet on the fly
@@ -424,25 +598,26 @@ int main(int argc, char** argv)
 
       // Cluster, sort jets by pT, and apply pT cut
       const vector<fastjet::PseudoJet> fj_jets = sorted_by_pt(
-        fastjet::ClusterSequence(particles, *jet_def).inclusive_jets(pt_cut)
+        clust->inclusive_jets(particles,pt_cut)
       );
 
       // Apply eta cut
       jets.reserve(fj_jets.size());
       for (auto& jet : fj_jets) {
         if (abs(jet.eta()) < eta_cut)
-          jets.emplace_back(jet,H_y,jets.size()<2);
+          jets.emplace_back(vec4::pseudojet(jet),H_y);
       }
     }
     const size_t njets = jets.size(); // number of jets
+    prof::stage(prof::fill);
+
+    if (elist_out && !entries_vbf && njets >= entries_njets)
+      elist_out->Enter(ent,tree);
 
     // ****************************************************
 
     int njets50 = 0;
-    for (auto& j : jets) {
-      if (j.pT>=50.) ++njets50;
-      else break;
-    }
+    for (auto& j : jets) if (j.pT>=50.) ++njets50;
 
     // Number of jets hists
     h_jets_N_excl.Fill(njets);
@@ -470,7 +645,7 @@ int main(int argc, char** argv)
       h_jet1_y   .Fill(jets[0].y);
       h_jet1_tau .Fill(jets[0].tau);
 
-      const Double_t H1j_pT = (higgs+(*jets[0].p)).Pt();
+      const Double_t H1j_pT = (higgs+jets[0].p).Pt();
 
       h_H1j_pT   .Fill(H1j_pT);
 
@@ -502,8 +677,8 @@ int main(int argc, char** argv)
         h_jet2_y   .Fill(jets[1].y);
         h_jet2_tau .Fill(jets[1].tau);
 
-        const TLorentzVector jj = (*jets[0].p)+(*jets[1].p);
-        const TLorentzVector H2j = higgs+jj;
+        const vec4 jj = jets[0].p+jets[1].p;
+        const vec4 H2j = higgs+jj;
 
         const Double_t H2j_mass      = H2j.M();
         const Double_t H2j_pT        = H2j.Pt();
@@ -511,7 +686,7 @@ int main(int argc, char** argv)
         const Double_t H_2j_deltay   = H_y - jj.Rapidity();
 
         const Double_t jj_mass       = jj.M();
-        const Double_t j_j_deltaphi  = jets[0].p->Phi() - jets[1].p->Phi();
+        const Double_t j_j_deltaphi  = jets[0].p.Phi() - jets[1].p.Phi();
         const Double_t j_j_deltay    = jets[0].y - jets[1].y;
 
         h_H2j_mass     .Fill(H2j_mass);
@@ -525,6 +700,8 @@ int main(int argc, char** argv)
 
         if (j_j_deltay>2.8) { // VBF cuts
           if (jj_mass>400) {
+            if (elist_out && entries_vbf && njets >= entries_njets)
+              elist_out->Enter(ent,tree);
             h_j_j_deltaphi_VBF.Fill(j_j_deltaphi);
             h_loose.Fill(0.5);
             if (H_2j_deltaphi>2.6) h_tight.Fill(0.5);
@@ -548,17 +725,50 @@ int main(int argc, char** argv)
 
   } // END of event loop
 
-  counter.prt(num_ent.second);
+  if (worker>=0) {
+    counter.prt(num_ent.second);
+    save(procs->data<Double_t>() + worker*slot);
+    workers::done();
+  }
+  if (procs) {
+    procs->wait();
+    const Double_t *p = procs->data<Double_t>();
+    for (unsigned i=0; i<nprocs; ++i) p = add(p);
+    num_ent = { all_first, num_ent.second };
+    cout << nprocs << " workers done" << endl;
+  } else counter.prt(num_ent.second);
+  if (mpi.size()>1) {
+    // rank 0 adds the sums of the other ranks to its own
+    vector<Double_t> buf(slot,0.);
+    if (mpi.rank()) save(buf.data());
+    mpi.sum(buf.data(), buf.size());
+    if (mpi.rank()) return 0;
+    add(buf.data());
+    cout << mpi.size() << " MPI ranks done" << endl;
+  }
   cout << endl;
   cout << "Selected events: " << num_selected << endl;
+  cache.report(cout);
+  if (elist_out) {
+    write_entry_list(elist_out, entries_out);
+    cout << "Entry list " << elist_out->GetName() << ": "
+         << elist_out->GetN() << " entries written to "
+         << entries_out << endl;
+  }
 
   // Close files
+  prof::stage(prof::write);
+  hist_block::write_all();
   fout->Write();
   fout->Close();
   delete fout;
   delete tree;
   delete sj_tree;
   delete wt_tree;
+  prof::stage(prof::other);
+
+  if (profile) prof::prt(cout, num_ent.second-num_ent.first);
+  if (prof_file.size()) prof::json(prof_file, num_ent.second-num_ent.first);
 
   return 0;
 }
@@ -1,7 +1,7 @@
 #include <iostream>
+#include <cstring>
 #include <iomanip>
 #include <vector>
-#include <ctime>
 
 #include <TFile.h>
 #include <TTree.h>
@@ -10,6 +10,7 @@
 #include <TH1.h>
 
 #include "csshists.hh"
+#include "timed_counter.hh"
 
 using namespace std;
 
@@ -36,38 +37,34 @@ int main(int argc, char** argv)
   TFile *fout = new TFile(argv[3],"recreate");
 
   vector<Float_t> x(numbr);
-  vector<TH1*> h;
+  vector<string> names;
+  names.reserve(numbr);
 
   for (size_t i=0;i<numbr;++i) {
     TBranch *br = dynamic_cast<TBranch*>(brarr->At(i));
-    string name = br->GetName();
-    cout << "Branch: " << name << endl;
-    br->SetAddress(&x[i]);
-    h.push_back(css.mkhist(name));
+    if (!strcmp(br->GetName(),"id")) { // event id, not a weight
+      tree->SetBranchStatus("id",0);
+      continue;
+    }
+    names.emplace_back(br->GetName());
+    cout << "Branch: " << names.back() << endl;
+    br->SetAddress(&x[names.size()-1]);
   }
+  const size_t numw = names.size();
+
+  const vector<TH1*> h = css.mkhists(names);
 
   const Long64_t nent = tree->GetEntries();
-  time_t time1=time(0), time2;
-  unsigned seconds = 0;
+  timed_counter counter(0,nent);
 
   cout << "Prepared to read " << nent << " entries" << endl;
   for (Long64_t ent=0; ent<nent; ++ent) {
-
+    counter(ent);
     tree->GetEntry(ent);
-    for (size_t i=0;i<numbr;++i) h[i]->Fill(x[i]);
-
-    // timed counter
-    if ( difftime(time2=time(0),time1) > 1 ) {
-      ++seconds;
-      cout << setw(10) << ent
-           << setw( 7) << seconds << 's';
-      cout.flush();
-      for (char i=0;i<18;++i) cout << '\b';
-      time1 = time2;
-    }
+    for (size_t i=0;i<numw;++i) h[i]->Fill(x[i]);
   }
-  cout << setw(10) << nent
-       << setw( 7) << seconds << 's' << endl << endl;
+  counter.prt(nent);
+  cout << endl << endl;
 
   fout->Write();
   fout->Close();
@@ -0,0 +1,36 @@
+// Writes file.eid with the eid group index of each BH file,
+// so that programs splitting entries at events do not scan the file
+
+#include <iostream>
+#include <string>
+
+#include <TChain.h>
+
+#include "eid_index.hh"
+
+using namespace std;
+
+int main(int argc, char** argv)
+{
+  if (argc<2) {
+    cout << "Usage: " << argv[0] << " bh.root ..." << endl;
+    exit(0);
+  }
+
+  for (int i=1; i<argc; ++i) {
+    TChain chain("t3");
+    if (!chain.AddFile(argv[i],-1)) exit(1);
+
+    const eid_index events(&chain,"id",false);
+    if (!events) {
+      cerr << "\033[31mNo id branch in " << argv[i] << "\033[0m" << endl;
+      exit(1);
+    }
+    events.write(string(argv[i])+".eid");
+
+    cout << argv[i] << ": " << events.entries() << " entries, "
+         << events.size() << " events" << endl;
+  }
+
+  return 0;
+}
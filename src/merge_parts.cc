@@ -1,157 +1,269 @@
 #include <iostream>
+#include <fstream>
 #include <string>
+#include <vector>
 #include <unordered_map>
+#include <utility>
+#include <thread>
+#include <algorithm>
 
+#include <glob.h>
+
+#include <boost/program_options.hpp>
+
+#include <TROOT.h>
 #include <TFile.h>
 #include <TDirectory.h>
 #include <TKey.h>
 #include <TH1.h>
 
 using namespace std;
+namespace po = boost::program_options;
 
 #define test(var) \
 cout <<"\033[36m"<< #var <<"\033[0m"<< " = " << var << endl;
 
-// Safely get an object from TDirectory
-template<class T>
-inline T* get(TDirectory* dir, const char* name) {
-  T *obj = nullptr;
-  dir->GetObject(name,obj);
-  if (obj) return obj;
-  else {
-    cerr << "No object " << name << " in " << dir->GetName() << endl;
+// Expand a part argument into a list of files **********************
+// A pattern with wildcards is globbed, a file not ending in .root is
+// read as a list of files, one per line
+vector<string> expand(const string& arg) {
+  vector<string> files;
+  if (arg.find_first_of("*?[")!=string::npos) {
+    glob_t g;
+    if (glob(arg.c_str(),0,nullptr,&g)==0)
+      files.assign(g.gl_pathv,g.gl_pathv+g.gl_pathc);
+    globfree(&g);
+  } else if (arg.size()<5 || arg.compare(arg.size()-5,5,".root")) {
+    ifstream list(arg);
+    if (!list) {
+      cerr << "\033[31mCannot open file list " << arg << "\033[0m" << endl;
+      exit(1);
+    }
+    string file;
+    while (list >> file) files.push_back(file);
+  } else files.push_back(arg);
+
+  if (files.empty()) {
+    cerr << "\033[31mNo files for part " << arg << "\033[0m" << endl;
     exit(1);
   }
+  return files;
 }
 
-int main(int argc, char** argv)
-{
-  if (argc<3) {
-    cout << "Usage: " << argv[0]
-         << " output_fout.root input_born.root input_real.root ..." << endl;
-    exit(0);
+// Running sum of histograms ****************************************
+// Holds one copy of every histogram, so memory does not depend on the
+// number of folded files
+class accum {
+  vector<pair<string,TH1*>> hists; // dir/name, in order of first file
+  unordered_map<string,size_t> index;
+  size_t nfiles = 0;
+
+  static void add(TH1* to, const TH1* h) {
+    const Double_t ent = to->GetEntries();
+    to->Add(h);
+    to->SetEntries(ent+h->GetEntries());
   }
 
-  // Track histograms
-  unordered_map<string,int> hist_names;
+  // add one histogram of a file other than the first
+  void add(const string& path, const TH1* h, const string& file) {
+    const auto it = index.find(path);
+    if (it==index.end()) {
+      cerr << "\033[31mUnexpected histogram " << path
+           << " in file " << file << "\033[0m" << endl;
+      exit(1);
+    }
+    add(hists[it->second].second,h);
+  }
 
-  // Output file
-  TFile *fout = new TFile(argv[1],"recreate");
-  if (fout->IsZombie()) exit(1);
-  cout << "Output file: " << fout->GetName() << endl;
+  void keep(const string& path, TH1* h) {
+    index[path] = hists.size();
+    hists.emplace_back(path,h);
+  }
 
-  for (int fi=2; fi<argc; ++fi) {
-    static bool first_file = true;
+public:
+  ~accum() { for (auto& h : hists) delete h.second; }
 
-    // Current input file
-    TFile *f = new TFile(argv[fi],"read");
+  // Fold one file, only this file is open
+  void fold(const string& file) {
+    TFile *f = new TFile(file.c_str(),"read");
     if (f->IsZombie()) exit(1);
-    cout << "\nInput file: " << f->GetName() << endl;
 
-    // Number of events
-    const Double_t N = get<TH1D>(f,"N")->GetAt(1);
-    const Double_t N_scale = 1./N;
-    cout << "Events: " << N << endl;
+    size_t nhists = 0;
+    auto take = [&](const string& path, TObject *obj) {
+      TH1 *h = static_cast<TH1*>(obj);
+      if (nfiles) { add(path,h,file); delete h; }
+      else keep(path,h);
+      ++nhists;
+    };
 
-    static TKey *key1;
     TIter nextkey1(f->GetListOfKeys());
-    while ((key1 = (TKey*)nextkey1())) { // loop over dirs
-      static TObject *obj1;
-      obj1 = key1->ReadObj();
+    while (TKey *key1 = (TKey*)nextkey1()) { // loop over dirs
+      TObject *obj1 = key1->ReadObj();
       if (obj1->InheritsFrom(TDirectory::Class())) {
-
-        static bool first_dir = true;
-
         TDirectory *dir = static_cast<TDirectory*>(obj1);
-        TDirectory *out_dir =
-          ( first_file ? fout->mkdir(dir->GetName())
-                       : get<TDirectory>(fout,dir->GetName()) );
-        if (first_file) out_dir->cd();
-
-        static TKey *key2;
         TIter nextkey2(dir->GetListOfKeys());
-        while ((key2 = (TKey*)nextkey2())) { // loop over hists
-          static TObject *obj2;
-          obj2 = key2->ReadObj();
-          if (obj2->InheritsFrom(TH1::Class())) {
-
-            TH1 *h = static_cast<TH1*>(obj2);
-
-            if (first_dir) {
-              hist_names[h->GetName()] = 1;
-            } else {
-              const auto it = hist_names.find(h->GetName());
-              if (it==hist_names.end()) {
-                cerr << "Unexpected histogram " << h->GetName()
-                     << " in file " << f->GetName()
-                     << " in dir " << dir->GetName();
-                exit(1);
-              } else {
-                ++it->second;
-              }
-            }
-
-            // Scale and add histograms
-            if (first_file) {
-              h->Scale(N_scale);
-              h->Clone();
-            } else {
-              TH1 *new_h = get<TH1>(out_dir,h->GetName());
-              Double_t ent = new_h->GetEntries();
-              new_h->Add(h,N_scale);
-              new_h->SetEntries(ent+h->GetEntries());
-            }
-
-          }
-        }
-
-        // Check if all histograms from the first directory were present
-        auto it = hist_names.begin();
-        const int first_counts = it->second;
-        for (auto end=hist_names.end(); it!=end; ++it) {
-          if (it->second != first_counts) {
-            cerr << "Expected hist "
-                 << (first_counts < it->second ? it->first
-                                               : hist_names.begin()->first)
-                 << " is not in file " << f->GetName()
-                 << " in dir " << dir->GetName();
-            exit(1);
-          }
+        while (TKey *key2 = (TKey*)nextkey2()) { // loop over hists
+          TObject *obj2 = key2->ReadObj();
+          if (obj2->InheritsFrom(TH1::Class()))
+            take(string(dir->GetName())+'/'+obj2->GetName(), obj2);
+          else delete obj2;
         }
+      } else if (obj1->InheritsFrom(TH1::Class())) {
+        take(obj1->GetName(), obj1);
+      } else delete obj1;
+    }
 
-        // no longer first directory
-        if (first_dir) first_dir = false;
+    delete f;
 
-      } else { // not a TDirectory
-        if (obj1->InheritsFrom(TH1::Class())) {
+    // Check if all histograms from the first file were present
+    if (nhists!=hists.size()) {
+      cerr << "\033[31mFile " << file << " has " << nhists
+           << " histograms instead of " << hists.size()
+           << "\033[0m" << endl;
+      exit(1);
+    }
+    ++nfiles;
+  }
 
-            TH1 *h = static_cast<TH1*>(obj1);
+  // Fold another accumulator
+  void fold(accum& other, Double_t scale=1) {
+    if (!other.nfiles) return;
+    if (nfiles && other.hists.size()!=hists.size()) {
+      cerr << "\033[31mParts have different numbers of histograms"
+           << "\033[0m" << endl;
+      exit(1);
+    }
+    for (auto& h : other.hists) {
+      if (scale!=1) h.second->Scale(scale);
+      if (nfiles) add(h.first,h.second,"part");
+      else {
+        keep(h.first,h.second);
+        h.second = nullptr; // taken over
+      }
+    }
+    nfiles += other.nfiles;
+  }
 
-            // Scale and add histograms
-            if (first_file) {
-              fout->cd();
-              h->Scale(N_scale);
-              h->Clone();
-            } else {
-              TH1 *new_h = get<TH1>(fout,h->GetName());
-              Double_t ent = new_h->GetEntries();
-              new_h->Add(h,N_scale);
-              new_h->SetEntries(ent+h->GetEntries());
-            }
+  Double_t N() const {
+    const auto it = index.find("N");
+    if (it==index.end()) {
+      cerr << "\033[31mNo histogram N\033[0m" << endl;
+      exit(1);
+    }
+    return hists[it->second].second->GetAt(1);
+  }
 
-        }
+  void write(TFile* fout) {
+    const auto it = index.find("N");
+    if (it!=index.end()) hists[it->second].second->SetAt(1,1);
+    for (auto& h : hists) {
+      const size_t sep = h.first.find('/');
+      TDirectory *dir = fout;
+      if (sep!=string::npos) {
+        const string name = h.first.substr(0,sep);
+        dir = fout->GetDirectory(name.c_str());
+        if (!dir) dir = fout->mkdir(name.c_str());
       }
+      h.second->SetDirectory(dir);
     }
+    hists.clear();
+    index.clear();
+  }
+};
 
-    delete f;
-    // no longer first file
-    if (first_file) first_file = false;
+// Sum files of a part with a parallel tree reduction ***************
+// Every thread folds a range of files into its own accumulator, and
+// the accumulators are then summed pairwise into acc[0]
+void reduce(vector<accum>& acc, const vector<string>& files) {
+  const size_t nthreads = acc.size();
+
+  vector<thread> threads;
+  for (size_t t=0; t<nthreads; ++t)
+    threads.emplace_back([&,t]{
+      for (size_t i=t*files.size()/nthreads,
+           n=(t+1)*files.size()/nthreads; i<n; ++i) acc[t].fold(files[i]);
+    });
+  for (auto& t : threads) t.join();
+
+  for (size_t step=1; step<nthreads; step*=2) {
+    threads.clear();
+    for (size_t t=0; t+step<nthreads; t+=2*step)
+      threads.emplace_back([&,t]{ acc[t].fold(acc[t+step]); });
+    for (auto& t : threads) t.join();
+  }
+}
+
+// ******************************************************************
+int main(int argc, char** argv)
+{
+  // START OPTIONS **************************************************
+  string output_file;
+  vector<string> parts;
+  unsigned nthreads;
+
+  try {
+    // General Options ------------------------------------
+    po::options_description desc("Options");
+    desc.add_options()
+      ("help,h", "produce help message")
+      ("output,o", po::value<string>(&output_file)->required(),
+       "*output root file")
+      ("parts,p", po::value<vector<string>>(&parts)->required(),
+       "*part: root file, quoted glob pattern, or file list;\n"
+       "files of a part are summed, then scaled by 1/N")
+      ("threads,j", po::value<unsigned>(&nthreads)
+       ->default_value(thread::hardware_concurrency()),
+       "number of threads reading files of a part")
+    ;
+
+    po::positional_options_description pos;
+    pos.add("output",1);
+    pos.add("parts",-1);
+
+    po::variables_map vm;
+    po::store(po::command_line_parser(argc, argv)
+      .options(desc).positional(pos).run(), vm);
+    if (argc == 1 || vm.count("help")) {
+      cout << "Usage: " << argv[0]
+           << " output.root born.root 'real_*.root' virt.list ..." << endl;
+      cout << desc << endl;
+      return 0;
+    }
+    po::notify(vm);
+    if (nthreads==0) nthreads = 1;
+  }
+  catch(exception& e) {
+    cerr << "\033[31mError: " <<  e.what() <<"\033[0m"<< endl;
+    exit(1);
   }
+  // END OPTIONS ****************************************************
+
+  ROOT::EnableThreadSafety();
+  TH1::AddDirectory(kFALSE); // histograms are owned by accumulators
+
+  // Output file
+  TFile *fout = new TFile(output_file.c_str(),"recreate");
+  if (fout->IsZombie()) exit(1);
+  cout << "Output file: " << fout->GetName() << endl;
+
+  accum total;
+  for (const auto& p : parts) {
+    const vector<string> files = expand(p);
+    cout << "\nPart: " << p << endl;
+    cout << "Files: " << files.size() << endl;
 
-  // Set N to 1
-  get<TH1D>(fout,"N")->SetAt(1,1);
+    vector<accum> acc(min<size_t>(nthreads,files.size()));
+    reduce(acc, files);
+
+    // Number of events
+    const Double_t N = acc[0].N();
+    cout << "Events: " << N << endl;
+
+    total.fold(acc[0], 1./N);
+  }
 
   // Write and close output root file
+  total.write(fout);
   fout->Write();
   cout << "\nWrote file: " << fout->GetName() << endl;
   delete fout;
@@ -2,18 +2,30 @@
 #include <fstream>
 #include <iomanip>
 #include <string>
+#include <vector>
 #include <unordered_map>
+#include <memory>
 #include <stdexcept>
+#include <algorithm>
 
 #include <boost/program_options.hpp>
 
+#include <TROOT.h>
 #include <TFile.h>
 #include <TTree.h>
+#include <TBranch.h>
+#include <TEntryList.h>
 
 #include "rapidxml-1.13/rapidxml.hpp"
 
 #include "rew_calc.hh"
+#include "branches.hh"
+#include "tree_cache.hh"
+#include "entry_list.hh"
+#include "workers.hh"
+#include "ranks.hh"
 #include "timed_counter.hh"
+#include "prof.hh"
 
 using namespace std;
 namespace po = boost::program_options;
@@ -62,9 +74,18 @@ BHEvent event; // extern
 // ******************************************************************
 int main(int argc, char** argv)
 {
+  // Entries are split between MPI ranks, if built with make mpi
+  const ranks mpi(argc, argv);
+  if (mpi.rank()) cout.setstate(ios::badbit); // rank 0 reports
+
   // START OPTIONS **************************************************
-  string BH_file, weights_file, pdf_set, xml_file;
-  bool old_bh, counter_newline;
+  string BH_file, weights_file, default_pdf, xml_file, prof_file;
+  string entries_in;
+  bool old_bh, counter_newline, profile;
+  Long64_t cache_size;
+  Int_t cache_learn;
+  bool prefetch;
+  unsigned nprocs;
   pair<Long64_t,Long64_t> num_ent {0,0};
 
   try {
@@ -78,33 +99,54 @@ int main(int argc, char** argv)
        "*configuration XML file")
       ("output,o", po::value<string>(&weights_file)->required(),
        "*output root file with new event weights")
-      ("pdf", po::value<string>(&pdf_set)->default_value("CT10nlo"),
-       "LHAPDF set name")
+      ("pdf", po::value<string>(&default_pdf)->default_value("CT10nlo"),
+       "LHAPDF set name,\nused where XML config gives no pdf")
       ("num-ent,n", po::value<pair<Long64_t,Long64_t>>(&num_ent),
        "process only this many entries,\nnum or first:num")
+      ("entries", po::value<string>(&entries_in),
+       "reweigh only the entries of the entry list\nin this file, "
+       "others get zero weights")
       ("old-bh", po::bool_switch(&old_bh),
        "read an old BH tree (no part & alphas_power branches)")
+      ("cache-size", po::value<Long64_t>(&cache_size)->default_value(-1),
+       "TTreeCache size in MB,\n0 disables, -1 keeps ROOT's default")
+      ("cache-learn", po::value<Int_t>(&cache_learn)->default_value(0),
+       "entries for the cache learning phase,\n0 caches the branches in use")
+      ("procs,p", po::value<unsigned>(&nprocs)->default_value(1),
+       "number of worker processes\ncalculating weights")
+      ("prefetch", po::bool_switch(&prefetch),
+       "read baskets asynchronously")
       ("counter-newline", po::bool_switch(&counter_newline),
        "do not overwrite previous counter message")
+      ("profile", po::bool_switch(&profile),
+       "print time spent in each stage of the event loop")
+      ("profile-json", po::value<string>(&prof_file),
+       "write profile to a JSON file")
     ;
 
     po::variables_map vm;
     po::store(po::parse_command_line(argc, argv, all_opt), vm);
     if (argc == 1 || vm.count("help")) {
       cout << all_opt << endl;
-      exit(0);
+      return 0;
     }
     po::notify(vm);
+    if (!nprocs)
+      throw runtime_error("Number of processes must be positive");
+    if (nprocs>1 && prefetch)
+      throw runtime_error("--prefetch cannot be used with --procs");
+    if (mpi.size()>1 && nprocs>1)
+      throw runtime_error("--procs cannot be used with MPI ranks");
   }
   catch(exception& e) {
     cerr << "\033[31mError: " <<  e.what() <<"\033[0m"<< endl;
-    exit(1);
+    mpi.abort(1);
   }
   // END OPTIONS ****************************************************
 
   // Open input event file
   TFile *fin = new TFile(BH_file.c_str(),"READ");
-  if (fin->IsZombie()) exit(1);
+  if (fin->IsZombie()) mpi.abort(1);
 
   cout << "Input BH event file: " << fin->GetName() << endl;
 
@@ -116,14 +158,28 @@ int main(int argc, char** argv)
     if (need_ent>tin->GetEntries()) {
       cerr << "Fewer entries in BH ntuple (" << tin->GetEntries()
          << ") then requested (" << need_ent << ')' << endl;
-      exit(1);
+      mpi.abort(1);
     }
   } else num_ent.second = tin->GetEntries();
 
   // Set up BlackHat event
   event.SetTree(tin, BHEvent::reweighting, old_bh);
 
-  tin->SetBranchAddress("weight", &event.weight);
+  branches::use(tin, "weight", &event.weight);
+  Int_t eid = -1; // copied to the weights tree to check alignment
+  branches::use(tin, "id", &eid);
+  TBranch *b_id = tin->GetBranch("id");
+
+  // Entries not in the entry list are written with zero weights,
+  // so that the weights tree stays aligned with the BH tree
+  TEntryList *elist = nullptr;
+  if (entries_in.size()) {
+    elist = entry_sublist(read_entry_list(entries_in),
+                          tin->GetName(), BH_file.c_str());
+    cout << "Entry list: " << elist->GetN() << " entries" << endl;
+  }
+  cout << branches::prune(tin) << endl;
+  tree_cache cache({tin}, cache_size, cache_learn, prefetch);
 
   if (old_bh) {
 
@@ -133,7 +189,7 @@ int main(int argc, char** argv)
     else if (BH_file.find("vsub")!=string::npos) event.SetPart('I');
     else {
       cerr << "\033[31mCannot determine part type from file name\033[0m" << endl;
-      exit(1);
+      mpi.abort(1);
     }
 
     const size_t jpos = BH_file.find_first_of('j');
@@ -147,31 +203,36 @@ int main(int argc, char** argv)
 
       } else {
         cerr << "\033[31mCannot determine number of jets from file name\033[0m" << endl;
-        exit(1);
+        mpi.abort(1);
       }
     } else {
       cerr << "\033[31mCannot determine number of jets from file name\033[0m" << endl;
-      exit(1);
+      mpi.abort(1);
     }
   }
 
-  // Load PDF
-  cout << endl;
-  usePDFset(pdf_set);
-  cout << endl;
-
-  // Open output weights file
-  TFile *fout = new TFile(weights_file.c_str(),"recreate");
-  if (fout->IsZombie()) exit(1);
+  // Open output weights file, only on rank 0
+  // Other ranks use the tree's branches only as buffers
+  TFile *fout = nullptr;
+  if (!mpi.rank()) {
+    fout = new TFile(weights_file.c_str(),"recreate");
+    if (fout->IsZombie()) mpi.abort(1);
 
-  cout << "Output weights file: " << fout->GetName() << endl;
+    cout << "Output weights file: " << fout->GetName() << endl;
+  } else gROOT->cd();
 
   TTree *tree = new TTree("weights","");
+  tree->Branch("id", &eid, "id/I");
 
   // Setup new weights - read xml config ****************************
+  unordered_map<string,string> pdf_names; // pdf name -> LHAPDF set name
+  unordered_map<string,pdf_set*> pdfs;    // LHAPDF set name -> PDF set
   unordered_map<string,const mu_fcn*> mu;
-  unordered_map<string,const fac_calc*> fac;
-  unordered_map<string,const ren_calc*> ren;
+  unordered_map<string,const fac_calc*> fac; // definitions
+  unordered_map<string,const ren_calc*> ren; // definitions
+  unordered_map<string,const char*> fac_pdf, ren_pdf;
+  unordered_map<string,const fac_calc*> fac_sets; // definitions with PDFs
+  unordered_map<string,const ren_calc*> ren_sets; // definitions with PDFs
   vector<const reweighter*> weights;
 
   rapidxml::xml_document<> doc;
@@ -185,6 +246,7 @@ int main(int argc, char** argv)
 	doc.parse<0>(buffer.data());
   // Find root node
 	const xml_node *format_node   = doc.first_node("bh_format");
+	const xml_node *pdfs_node     = doc.first_node("pdfs");
 	const xml_node *energies_node = doc.first_node("energies");
 	const xml_node *scales_node   = doc.first_node("scales");
 	const xml_node *weights_node  = doc.first_node("weights");
@@ -192,15 +254,15 @@ int main(int argc, char** argv)
   // Check that nodes exist
   if (!energies_node) {
     cerr << "No energies node in XML config file" << endl;
-    exit(1);
+    mpi.abort(1);
   }
   if (!scales_node) {
     cerr << "No scales node in XML config file" << endl;
-    exit(1);
+    mpi.abort(1);
   }
   if (!weights_node) {
     cerr << "No weights node in XML config file" << endl;
-    exit(1);
+    mpi.abort(1);
   }
 
   if (format_node) {
@@ -210,6 +272,35 @@ int main(int argc, char** argv)
     }
   }
 
+  if (pdfs_node) node_loop(pdfs_node,"pdf") {
+    const char* name = get_attr(node,"name");
+    if (pdf_names.count(name)) {
+      cerr << "Warning: already existing pdf definition " << name
+           << " is replaced" << endl;
+    }
+    pdf_names[name] = get_attr(node,"set");
+  }
+
+  // PDF sets are loaded only once they are used by a weight
+  auto get_pdf = [&](const char* name) -> pdf_set* {
+    string setname(default_pdf);
+    if (name) {
+      const auto it = pdf_names.find(name);
+      if (it==pdf_names.end()) {
+        cerr << "Undefined pdf " << name << " in XML config file" << endl;
+        mpi.abort(1);
+      }
+      setname = it->second;
+    }
+    pdf_set*& set = pdfs[setname];
+    if (!set) {
+      cout << endl;
+      set = new pdf_set(setname);
+      cout << endl;
+    }
+    return set;
+  };
+
   node_loop_all(energies_node) {
     const char* tag_name = node->name();
     const char* name = get_attr(node,"name");
@@ -230,7 +321,7 @@ int main(int argc, char** argv)
       mu[name] = new mu_ren_default();
     else {
       cerr << "Warning: unrecognized energy definition: " << tag_name << endl;
-      exit(1);
+      mpi.abort(1);
     }
   }
 
@@ -242,7 +333,7 @@ int main(int argc, char** argv)
       delete fac[name];
     }
 
-    fac_calc *_fac = new fac_calc(mu[get_attr(node,"energy")]);
+    fac_calc *_fac = new fac_calc(mu[get_attr(node,"energy")], nullptr);
 
     if (const xml_attr* pdfunc = node->first_attribute("pdfunc")) {
       if (!strcmp(pdfunc->value(),"true"))
@@ -253,6 +344,9 @@ int main(int argc, char** argv)
         _fac->defaultPDF = true;
     }
 
+    const xml_attr* pdf = node->first_attribute("pdf");
+    fac_pdf[name] = (pdf ? pdf->value() : nullptr);
+
     fac[name] = _fac;
   }
 
@@ -264,7 +358,7 @@ int main(int argc, char** argv)
       delete ren[name];
     }
 
-    ren_calc *_ren = new ren_calc( mu[get_attr(node,"energy")] );
+    ren_calc *_ren = new ren_calc( mu[get_attr(node,"energy")], nullptr );
 
     if (const xml_attr* alphas = node->first_attribute("alphas")) {
       if (!strcmp(alphas->value(),"two_mH"))
@@ -275,16 +369,42 @@ int main(int argc, char** argv)
         _ren->defaultPDF = true;
     }
 
+    const xml_attr* pdf = node->first_attribute("pdf");
+    ren_pdf[name] = (pdf ? pdf->value() : nullptr);
+
     ren[name] = _ren;
   }
 
   node_loop(weights_node,"weight") {
     const xml_attr* pdfunc = node->first_attribute("pdfunc");
+    const xml_attr* pdf = node->first_attribute("pdf");
     const char* fac_name = get_attr(node,"fac");
     const char* ren_name = get_attr(node,"ren");
+    if (!fac.count(fac_name)) {
+      cerr << "Undefined fac scale " << fac_name << endl;
+      mpi.abort(1);
+    }
+    if (!ren.count(ren_name)) {
+      cerr << "Undefined ren scale " << ren_name << endl;
+      mpi.abort(1);
+    }
+
+    // Weight's pdf overrides the ones of fac and ren
+    pdf_set *fac_set = get_pdf(pdf ? pdf->value() : fac_pdf[fac_name]);
+    pdf_set *ren_set = get_pdf(pdf ? pdf->value() : ren_pdf[ren_name]);
+
+    // fac and ren are calculated once per PDF set
+    const fac_calc*& _fac = fac_sets[string(fac_name)+'/'+fac_set->name];
+    if (!_fac) {
+      _fac = new fac_calc(*fac[fac_name],fac_set);
+      if (_fac->pdf_unc) fac_set->mkmembers();
+    }
+    const ren_calc*& _ren = ren_sets[string(ren_name)+'/'+ren_set->name];
+    if (!_ren) _ren = new ren_calc(*ren[ren_name],ren_set);
+
     weights.push_back( new reweighter(
-      make_pair(fac[fac_name],fac_name),
-      make_pair(ren[ren_name],ren_name),
+      make_pair(_fac,fac_name),
+      make_pair(_ren,ren_name),
       tree,
       pdfunc && !strcmp(pdfunc->value(),"true")
     ) );
@@ -292,32 +412,102 @@ int main(int argc, char** argv)
 
   // Reading entries from the input ntuple ***************************
   cout << "\nReading " << num_ent.second << " entries" << endl;
-  timed_counter counter(counter_newline);
   num_ent.second += num_ent.first;
+  timed_counter counter(num_ent.first,num_ent.second,counter_newline);
 
   cout << scientific;
   cout.precision(10);
 
-  for (Long64_t ent=num_ent.first; ent<num_ent.second; ++ent) {
-    counter(ent);
+  if (profile || prof_file.size()) prof::start();
+
+  // Read the entry and calculate its weights
+  auto process = [&](Long64_t ent) {
+    prof::stage(prof::io);
+    if (elist && !elist->Contains(ent)) {
+      if (b_id) b_id->GetEntry(ent);
+      prof::stage(prof::write);
+      for (auto w : weights) w->zero();
+      return;
+    }
     tin->GetEntry(ent);
 
     // use event id for event number
     event.eid = ent;
 
     // REWEIGHTING
-    for (auto f : fac) f.second->calc();
-    for (auto r : ren) r.second->calc();
+    prof::stage(prof::scales);
+    for (auto m : mu) m.second->calc();
+    prof::stage(prof::pdf);
+    for (auto f : fac_sets) f.second->calc();
+    for (auto r : ren_sets) r.second->calc();
     for (auto w : weights) w->stitch();
-    tree->Fill();
+    prof::stage(prof::write);
+  };
+
+  if (nprocs>1 || mpi.size()>1) {
+    // Worker processes or MPI ranks calculate weights of slices of
+    // a chunk of entries into rows, which are filled in order by
+    // the parent or by rank 0
+    const unsigned n = (nprocs>1 ? nprocs : mpi.size());
+    const tree_row row(tree);
+    const Long64_t chunk = max<Long64_t>(1, min<Long64_t>(
+      (Long64_t(64)<<20)/row.size(), num_ent.second-num_ent.first));
+    unique_ptr<workers> procs;
+    vector<char> buf;
+    if (nprocs>1) procs.reset( new workers(nprocs, chunk*row.size()) );
+    else buf.resize(chunk*row.size());
+    char *rows = (procs ? procs->data<char>() : buf.data());
+    vector<int> counts(n);
+
+    for (Long64_t first=num_ent.first; first<num_ent.second; first+=chunk) {
+      const Long64_t end = min(first+chunk, num_ent.second), len = end-first;
+      auto slice = [=](unsigned i){ return first + len*i/n; };
+      auto calc = [&](unsigned i) {
+        for (Long64_t ent=slice(i), last=slice(i+1); ent<last; ++ent) {
+          process(ent);
+          row.save(rows + (ent-first)*row.size());
+        }
+      };
+      if (procs) {
+        const int w = procs->fork();
+        if (w>=0) {
+          calc(w);
+          workers::done();
+        }
+        procs->wait();
+      } else {
+        calc(mpi.rank());
+        for (unsigned i=0; i<n; ++i)
+          counts[i] = (slice(i+1)-slice(i))*row.size();
+        mpi.gather(rows, counts);
+        if (mpi.rank()) continue;
+      }
+      for (Long64_t ent=first; ent<end; ++ent) {
+        row.load(rows + (ent-first)*row.size());
+        tree->Fill();
+      }
+      counter.add(len);
+    }
+  } else {
+    for (Long64_t ent=num_ent.first; ent<num_ent.second; ++ent) {
+      counter(ent);
+      process(ent);
+      tree->Fill();
+    }
   }
+  if (mpi.rank()) return 0; // only rank 0 writes
   counter.prt(num_ent.second);
   cout << endl;
+  cache.report(cout);
 
   fout->Write();
   cout << "\n\033[32mWrote\033[0m: " << fout->GetName() << endl;
   fout->Close();
   delete fout;
+  prof::stage(prof::other);
+
+  if (profile) prof::prt(cout, num_ent.second-num_ent.first);
+  if (prof_file.size()) prof::json(prof_file, num_ent.second-num_ent.first);
 
   fin->Close();
   delete fin;
@@ -325,7 +515,10 @@ int main(int argc, char** argv)
   for (auto m : mu)  delete m.second;
   for (auto f : fac) delete f.second;
   for (auto r : ren) delete r.second;
+  for (auto f : fac_sets) delete f.second;
+  for (auto r : ren_sets) delete r.second;
   for (auto w : weights) delete w;
+  for (auto p : pdfs) delete p.second;
 
   return 0;
 }
@@ -0,0 +1,193 @@
+// Converts SpartyJet trees with vector branches
+// into trees with count-plus-array branches, read by SJClusterAlg
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <numeric>
+#include <algorithm>
+
+#include <boost/program_options.hpp>
+
+#include <TFile.h>
+#include <TTree.h>
+#include <TChain.h>
+#include <TBranch.h>
+#include <TObjArray.h>
+
+#include "SJClusterAlg.hh"
+#include "branches.hh"
+#include "timed_counter.hh"
+
+using namespace std;
+namespace po = boost::program_options;
+
+// Jets of one algorithm ********************************************
+struct sj_alg {
+  const string name;
+  Int_t N;
+  vector<Float_t> *eta, *phi, *mass, *pt;
+  Float_t flat_eta[SJMAXNJ], flat_phi[SJMAXNJ],
+          flat_mass[SJMAXNJ], flat_pt[SJMAXNJ];
+  Int_t order[SJMAXNJ];
+
+  sj_alg(TTree* in, TTree* out, const string& name)
+  : name(name), N(0), eta(0), phi(0), mass(0), pt(0)
+  {
+    in_branch(in, "N", &N);
+    in_branch(in, "eta", &eta);
+    in_branch(in, "phi", &phi);
+    in_branch(in, "mass", &mass);
+    in_branch(in, "pt", &pt);
+
+    const string count = name+"_N";
+    out->Branch(count.c_str(), &N, (count+"/I").c_str());
+    out_branch(out, "eta", flat_eta);
+    out_branch(out, "phi", flat_phi);
+    out_branch(out, "mass", flat_mass);
+    out_branch(out, "pt", flat_pt);
+  }
+
+  template<typename T>
+  void in_branch(TTree* in, const char* var, T* addr) {
+    if ( branches::use(in, name+'_'+var, addr)
+         == TTree::kMissingBranch ) exit(1);
+  }
+  void out_branch(TTree* out, const char* var, Float_t* addr) {
+    const string br = name+'_'+var;
+    out->Branch(br.c_str(), addr, (br+'['+name+"_N]/F").c_str());
+  }
+
+  void flatten(bool sort_pt) {
+    if (N > SJMAXNJ) {
+      cerr << "\033[31m" << N << " " << name << " jets in the entry,"
+              " more than SJMAXNJ = " << SJMAXNJ << "\033[0m" << endl;
+      exit(1);
+    }
+    iota(order, order+N, 0);
+    if (sort_pt) {
+      const Float_t *_pt = pt->data();
+      stable_sort(order, order+N,
+        [_pt](Int_t i, Int_t j){ return _pt[i] > _pt[j]; } // decending order
+      );
+    }
+    for (Int_t i=0;i<N;++i) {
+      const Int_t j = order[i];
+      flat_eta [i] = (*eta )[j];
+      flat_phi [i] = (*phi )[j];
+      flat_mass[i] = (*mass)[j];
+      flat_pt  [i] = (*pt  )[j];
+    }
+  }
+};
+
+int main(int argc, char** argv)
+{
+  // START OPTIONS **************************************************
+  vector<string> input_files, algs;
+  string output_file, tree_name;
+  bool sort_pt;
+
+  try {
+    // General Options ------------------------------------
+    po::options_description desc("Options");
+    desc.add_options()
+      ("help,h", "produce help message")
+      ("input,i", po::value<vector<string>>(&input_files)->required(),
+       "*add input SpartyJet root file")
+      ("output,o", po::value<string>(&output_file)->required(),
+       "*output root file with flat SpartyJet tree")
+      ("alg,a", po::value<vector<string>>(&algs),
+       "keep only these jet algorithms, e.g. AntiKt4;\n"
+       "if skipped: all algorithms are kept")
+      ("sort-pt", po::bool_switch(&sort_pt),
+       "order jets by decreasing pT")
+      ("tree", po::value<string>(&tree_name)
+       ->default_value("SpartyJet_Tree"),
+       "name of the input and output trees")
+    ;
+
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+    if (argc == 1 || vm.count("help")) {
+      cout << desc << endl;
+      return 0;
+    }
+    po::notify(vm);
+  }
+  catch(exception& e) {
+    cerr << "\033[31mError: " <<  e.what() <<"\033[0m"<< endl;
+    exit(1);
+  }
+  // END OPTIONS ****************************************************
+
+  TChain *in = new TChain(tree_name.c_str());
+  cout << "Input files:" << endl;
+  for (auto& f : input_files) {
+    cout << "  " << f << endl;
+    if (!in->AddFile(f.c_str(),-1) ) exit(1);
+  }
+  cout << endl;
+
+  // Find algorithms from their jet count branches
+  if (algs.empty()) {
+    in->LoadTree(0);
+    const TObjArray *br = in->GetListOfBranches();
+    for (Int_t i=0,n=br->GetEntries();i<n;++i) {
+      const string name = br->At(i)->GetName();
+      if (name.size()>2 && !name.compare(name.size()-2,2,"_N"))
+        algs.emplace_back(name,0,name.size()-2);
+    }
+    if (algs.empty()) {
+      cerr << "\033[31mNo jet algorithms in " << tree_name
+           << "\033[0m" << endl;
+      exit(1);
+    }
+  }
+
+  TFile *fout = new TFile(output_file.c_str(),"recreate");
+  if (fout->IsZombie()) exit(1);
+  cout << "Output file: " << fout->GetName() << endl << endl;
+
+  TTree *out = new TTree(tree_name.c_str(),"");
+
+  // Event id is kept for alignment checks
+  Int_t eid;
+  const bool has_id = (in->GetBranch("id") != nullptr);
+  if (has_id) {
+    branches::use(in, "id", &eid);
+    out->Branch("id", &eid, "id/I");
+  }
+
+  vector<unique_ptr<sj_alg>> jets;
+  cout << "Algorithms:" << endl;
+  for (auto& name : algs) {
+    cout << "  " << name << endl;
+    jets.emplace_back(new sj_alg(in,out,name));
+  }
+  cout << endl;
+
+  cout << branches::prune(in) << endl << endl;
+
+  const Long64_t nent = in->GetEntries();
+  cout << "Reading " << nent << " entries" << endl;
+  timed_counter counter(0,nent);
+
+  for (Long64_t ent=0; ent<nent; ++ent) {
+    counter(ent);
+    in->GetEntry(ent);
+    for (auto& j : jets) j->flatten(sort_pt);
+    out->Fill();
+  }
+  counter.prt(nent);
+  cout << endl;
+
+  fout->Write();
+  fout->Close();
+  delete fout;
+
+  delete in;
+
+  return 0;
+}
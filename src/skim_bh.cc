@@ -0,0 +1,252 @@
+// Writes the entries of BH ntuples that pass a jet preselection,
+// keeping whole events and only the branches used by the programs
+
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <memory>
+#include <algorithm>
+#include <stdexcept>
+
+#include <boost/program_options.hpp>
+
+#include <TFile.h>
+#include <TTree.h>
+#include <TChain.h>
+#include <TBranch.h>
+#include <TObjArray.h>
+#include <TParameter.h>
+#include <Compression.h>
+
+#include <fastjet/ClusterSequence.hh>
+
+#include "BHEvent.hh"
+#include "small_cluster.hh"
+#include "branches.hh"
+#include "eid_index.hh"
+#include "timed_counter.hh"
+
+using namespace std;
+namespace po = boost::program_options;
+
+// ******************************************************************
+fastjet::JetDefinition* JetDef(string& str) {
+  string::iterator it = --str.end();
+  while (isdigit(*it)) --it;
+  ++it;
+  string name;
+  transform(str.begin(), it, back_inserter(name), ::tolower);
+  fastjet::JetAlgorithm alg;
+  if (!name.compare("antikt")) alg = fastjet::antikt_algorithm;
+  else if (!name.compare("kt")) alg = fastjet::kt_algorithm;
+  else if (!name.compare("cambridge")) alg = fastjet::cambridge_algorithm;
+  else throw runtime_error("Undefined jet clustering algorithm: "+name);
+  return new fastjet::JetDefinition(
+    alg,
+    atof( string(it,str.end()).c_str() )/10.
+  );
+}
+
+// ******************************************************************
+int main(int argc, char** argv)
+{
+  // START OPTIONS **************************************************
+  vector<string> bh_files;
+  string output_file, jet_alg, select, compression;
+  double pt_cut, eta_cut;
+  size_t njets;
+  Int_t level, basket_size;
+  bool counter_newline;
+
+  const unordered_map<string,BHEvent::select_t> selects {
+    {"all", BHEvent::all},
+    {"kinematics", BHEvent::kinematics},
+    {"reweighting", BHEvent::reweighting},
+    {"cross_section", BHEvent::cross_section}
+  };
+  const unordered_map<string,ROOT::ECompressionAlgorithm> algorithms {
+    {"zlib", ROOT::kZLIB},
+    {"lzma", ROOT::kLZMA},
+    {"lz4", ROOT::kLZ4}
+  };
+
+  try {
+    // General Options ------------------------------------
+    po::options_description desc("Options");
+    desc.add_options()
+      ("help,h", "produce help message")
+      ("bh", po::value< vector<string> >(&bh_files)->required(),
+       "*add input BlackHat root file")
+      ("output,o", po::value<string>(&output_file)->required(),
+       "*output BlackHat root file")
+      ("cluster,c", po::value<string>(&jet_alg)->default_value("AntiKt4"),
+       "jet clustering algorithm: e.g. antikt4, kt6")
+      ("njets,j", po::value<size_t>(&njets)->default_value(1),
+       "minimum number of jets")
+      ("jet-pt-cut", po::value<double>(&pt_cut)->default_value(20.,"20"),
+       "loose jet pT cut in GeV")
+      ("jet-eta-cut", po::value<double>(&eta_cut)->default_value(4.4,"4.4"),
+       "loose jet eta cut")
+      ("select,s", po::value<string>(&select)->default_value("kinematics"),
+       "branches to keep, as read by\n"
+       "all, kinematics, reweighting or cross_section;\n"
+       "id and weight are always kept")
+      ("compression", po::value<string>(&compression)->default_value("lz4"),
+       "compression algorithm: zlib, lzma or lz4")
+      ("level", po::value<Int_t>(&level)->default_value(4),
+       "compression level")
+      ("basket-size", po::value<Int_t>(&basket_size)->default_value(0),
+       "basket size in bytes of every branch,\n0 keeps the input basket sizes")
+      ("counter-newline", po::bool_switch(&counter_newline),
+       "do not overwrite previous counter message")
+    ;
+
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+    if (argc == 1 || vm.count("help")) {
+      cout << desc << endl;
+      return 0;
+    }
+    po::notify(vm);
+
+    if (!selects.count(select))
+      throw runtime_error("Undefined branch selection: "+select);
+    if (!algorithms.count(compression))
+      throw runtime_error("Undefined compression algorithm: "+compression);
+  }
+  catch(exception& e) {
+    cerr << "\033[31mError: " <<  e.what() <<"\033[0m"<< endl;
+    exit(1);
+  }
+  // END OPTIONS ****************************************************
+
+  // Setup input files **********************************************
+  TChain *tree = new TChain("t3");
+
+  cout << "BH files:" << endl;
+  for (auto& f : bh_files) {
+    cout << "  " << f << endl;
+    if (!tree->AddFile(f.c_str(),-1) ) exit(1);
+  }
+  cout << endl;
+
+  // Entries of an event are kept or dropped together
+  const eid_index events(tree);
+  if (!events) {
+    cerr << "\033[31mNo id branch in BH chain\033[0m" << endl;
+    exit(1);
+  }
+
+  // Branches to write
+  BHEvent event;
+  event.SetTree(tree, selects.at(select));
+  branches::use(tree, "id", &event.eid);
+  branches::use(tree, "weight", &event.weight);
+  branches::prune(tree);
+
+  // Open output file ***********************************************
+  TFile *fout = new TFile(output_file.c_str(),"recreate");
+  if (fout->IsZombie()) exit(1);
+  cout << "Output file: " << fout->GetName() << endl << endl;
+
+  // Output branches share addresses with the input ones
+  TTree *tout = tree->CloneTree(0);
+  tout->SetDirectory(fout);
+  const Int_t settings = ROOT::CompressionSettings(
+    algorithms.at(compression), level);
+  fout->SetCompressionSettings(settings);
+  TObjArray *br = tout->GetListOfBranches();
+  for (Int_t i=0,n=br->GetEntries();i<n;++i)
+    static_cast<TBranch*>(br->At(i))->SetCompressionSettings(settings);
+  if (basket_size>0) tout->SetBasketSize("*",basket_size);
+
+  cout << "Writing " << br->GetEntries() << " branches, "
+       << compression << " level " << level << endl;
+
+  // Branches to read also include those for the preselection
+  event.SetTree(tree, BHEvent::kinematics);
+  cout << branches::prune(tree) << endl << endl;
+
+  // Jet Clustering Algorithm
+  unique_ptr<fastjet::JetDefinition> jet_def( JetDef(jet_alg) );
+  small_cluster clust(*jet_def);
+  cout << "Clustering with " << jet_def->description() << endl;
+  cout << "Preselection: " << njets << " jets with pT >= " << pt_cut
+       << " GeV and |eta| < " << eta_cut << endl << endl;
+
+  // Preselection ***************************************************
+  vector<fastjet::PseudoJet> particles;
+  auto pass = [&]() {
+    if (event.nparticle>BHMAXNP) {
+      cerr << "More particles in the entry then BHMAXNP" << endl
+           << "Increase array length to " << event.nparticle << endl;
+      exit(1);
+    }
+
+    // The Higgs is not clustered
+    particles.clear();
+    bool higgs = false;
+    for (Int_t i=0; i<event.nparticle; ++i) {
+      if (event.kf[i]==25) { higgs = true; continue; }
+      particles.emplace_back(
+        event.px[i],event.py[i],event.pz[i],event.E[i]
+      );
+    }
+    if (!higgs) return false;
+
+    size_t n = 0;
+    for (const auto& jet : clust.inclusive_jets(particles,pt_cut))
+      if (abs(jet.eta()) < eta_cut) ++n;
+    return n >= njets;
+  };
+
+  // Reading entries from the input TChain ***************************
+  const Long64_t nent = events.entries();
+  Long64_t num_events = 0, num_ent = 0;
+  cout << "Reading " << nent << " entries of "
+       << events.size() << " events" << endl;
+  timed_counter counter(0,nent,counter_newline);
+
+  for (size_t g=0, ng=events.size(); g<ng; ++g) {
+    const Long64_t first = events[g],
+                   end   = (g+1<ng ? events[g+1] : nent);
+    counter.add(end-first);
+
+    bool passed = false;
+    Long64_t ent = first;
+    for (; ent<end && !passed; ++ent) {
+      tree->GetEntry(ent);
+      passed = pass();
+    }
+    if (!passed) continue;
+
+    ++num_events;
+    num_ent += end-first;
+    if (end-first==1) tout->Fill(); // the entry is still read
+    else for (ent=first; ent<end; ++ent) {
+      tree->GetEntry(ent);
+      tout->Fill();
+    }
+  }
+  counter.prt(nent);
+  cout << endl;
+
+  cout << "Kept " << num_ent << " of " << nent << " entries, "
+       << num_events << " of " << events.size() << " events" << endl;
+
+  // Dropped events are saved, including those dropped from the inputs,
+  // so that they are still counted when the skim is read
+  const Long64_t dropped = events.size() - num_events + dropped_events(tree);
+  fout->Append(new TParameter<Long64_t>("dropped_events",dropped));
+  cout << "Dropped " << dropped << " events" << endl;
+
+  fout->Write();
+  fout->Close();
+  delete fout;
+
+  delete tree;
+
+  return 0;
+}
@@ -5,12 +5,15 @@
 #include <sstream>
 #include <vector>
 #include <stdexcept>
+#include <cstdlib>
 
 #include <boost/regex.hpp>
 #include <boost/unordered_map.hpp>
 #include <boost/algorithm/string.hpp>
 
 #include <TH1.h>
+#include <TH2.h>
+#include <TProfile.h>
 
 using namespace std;
 
@@ -19,7 +22,9 @@ using namespace std;
 
 // Properties *******************************************************
 
-enum prop_t { kClass, kBins, kLineColor, kLineWidth };
+enum prop_t {
+  kClass, kBins, kBinsY, kBinnedIn, kLineColor, kLineWidth, nprops
+};
 
 /*
 
@@ -94,6 +99,30 @@ struct prop_Bin_edges: public prop_Bins {
   }
 };
 
+struct prop_BinnedIn: public prop {
+  vector<csshists::binned_in> slices;
+  prop_BinnedIn(const string& str) {
+    // variables are separated by |, leading > means cumulative thresholds
+    vector<string> vars;
+    boost::algorithm::split(vars, str, boost::is_any_of("|"));
+    for (const auto& var : vars) {
+      stringstream ss(var);
+      csshists::binned_in b;
+      b.above = (ss >> ws).peek()=='>';
+      if (b.above) ss.get();
+      double edge;
+      while (ss >> edge) b.edges.push_back(edge);
+      if (b.edges.size() < (b.above ? 1 : 2)) throw runtime_error(
+        "too few edges in BinnedIn: "+str
+      );
+      slices.push_back(b);
+    }
+  }
+  virtual ~prop_BinnedIn() { }
+  // this property is used for booking of slices
+  virtual void apply(TH1* h) const { }
+};
+
 struct prop_int: public prop {
   int x;
   prop_int(const string& str): x( atoi(str.c_str()) ) { }
@@ -136,6 +165,15 @@ pair<prop_t,const prop*> mkprop(const string& str) {
   } else if (!ps.first.compare("BinEdges")) {
     type = kBins;
     p = new const prop_Bin_edges(ps.second);
+  } else if (!ps.first.compare("BinsY")) {
+    type = kBinsY;
+    p = new const prop_Bins_range(ps.second);
+  } else if (!ps.first.compare("BinEdgesY")) {
+    type = kBinsY;
+    p = new const prop_Bin_edges(ps.second);
+  } else if (!ps.first.compare("BinnedIn")) {
+    type = kBinnedIn;
+    p = new const prop_BinnedIn(ps.second);
   } else if (!ps.first.compare("LineColor")) {
     type = kLineColor;
     p = new const prop_LineColor(ps.second);
@@ -149,33 +187,155 @@ pair<prop_t,const prop*> mkprop(const string& str) {
   return make_pair(type,p);
 }
 
-typedef boost::unordered_map<prop_t, const prop*> prop_map;
+// Histogram factory ************************************************
+
+typedef TH1* (*factory_t)(const string& name,
+                          const prop_Bins* x, const prop_Bins* y);
+
+template<class H>
+TH1* mk(const string& name, const prop_Bins* x, const prop_Bins*) {
+  if (x->isrange) {
+    const prop_Bins_range* b = static_cast<const prop_Bins_range*>(x);
+    return new H(name.c_str(),"",b->nbinsx,b->xlow,b->xup);
+  } else {
+    const prop_Bin_edges* b = static_cast<const prop_Bin_edges*>(x);
+    return new H(name.c_str(),"",b->xbins.size()-1,&b->xbins[0]);
+  }
+}
+
+template<class H, class... X>
+TH1* mk2y(const string& name, const prop_Bins* y, X... x) {
+  if (y->isrange) {
+    const prop_Bins_range* b = static_cast<const prop_Bins_range*>(y);
+    return new H(name.c_str(),"",x...,b->nbinsx,b->xlow,b->xup);
+  } else {
+    const prop_Bin_edges* b = static_cast<const prop_Bin_edges*>(y);
+    return new H(name.c_str(),"",x...,b->xbins.size()-1,&b->xbins[0]);
+  }
+}
+
+template<class H>
+TH1* mk2(const string& name, const prop_Bins* x, const prop_Bins* y) {
+  if (x->isrange) {
+    const prop_Bins_range* b = static_cast<const prop_Bins_range*>(x);
+    return mk2y<H>(name,y,Int_t(b->nbinsx),b->xlow,b->xup);
+  } else {
+    const prop_Bin_edges* b = static_cast<const prop_Bin_edges*>(x);
+    return mk2y<H>(name,y,Int_t(b->xbins.size()-1),&b->xbins[0]);
+  }
+}
+
+struct factory {
+  factory_t mk;
+  bool is2d; // needs y binning
+};
+
+const boost::unordered_map<string,factory> factories {
+  {"TH1F", {mk<TH1F>, false}},
+  {"TH1D", {mk<TH1D>, false}},
+  {"TH1I", {mk<TH1I>, false}},
+  {"TH1C", {mk<TH1C>, false}},
+  {"TH1S", {mk<TH1S>, false}},
+  {"TH2F", {mk2<TH2F>, true}},
+  {"TH2D", {mk2<TH2D>, true}},
+  {"TProfile", {mk<TProfile>, false}}
+};
 
 // PIMPL ************************************************************
 
 struct csshists::impl {
-  vector< pair<const boost::regex*,prop_map*> > rules;
+  struct rule {
+    const boost::regex re;
+    const prop* props[nprops];
+
+    rule(const string& str): re(str) {
+      for (int i=0;i<nprops;++i) props[i] = nullptr;
+    }
+    ~rule() {
+      for (int i=0;i<nprops;++i) delete props[i];
+    }
+  };
+  vector<rule*> rules;
+
+  // Properties resolved from all rules for a histogram name
+  struct resolved {
+    factory_t mk;
+    const prop_Bins *bins, *binsy;
+    const prop_BinnedIn* slices;
+    vector<const prop*> props; // applied after construction
+  };
+  boost::unordered_map<string,resolved> cache;
+
+  const resolved& resolve(const string& name);
 
   ~impl() {
-    for (size_t i=0,n=rules.size();i<n;++i) {
-      delete rules[i].first;
-      for (prop_map::iterator it=rules[i].second->begin(),
-           end=rules[i].second->end();it!=end;++it)
-      {
-        delete it->second;
-      }
-      delete rules[i].second;
+    for (size_t i=0,n=rules.size();i<n;++i) delete rules[i];
+  }
+};
+
+const csshists::impl::resolved& csshists::impl::resolve(const string& name) {
+  const boost::unordered_map<string,resolved>::iterator it = cache.find(name);
+  if (it!=cache.end()) return it->second;
+
+  // later rules take precedence
+  const prop* props[nprops] = { };
+  bool matched = false;
+  for (size_t i=0,n=rules.size();i<n;++i) {
+    if (boost::regex_match(name, rules[i]->re)) {
+      matched = true;
+      for (int j=0;j<nprops;++j)
+        if (rules[i]->props[j]) props[j] = rules[i]->props[j];
     }
   }
 
-  typedef vector< pair<const boost::regex*,prop_map*> >::iterator iter;
-};
+  if (!matched) throw runtime_error(
+    "no rules matched for histogram \""+name+"\""
+  );
+
+  if (!props[kClass]) throw runtime_error(
+    "cannot find class for histogram \""+name+"\""
+  );
+  const string& class_name = static_cast<const prop_Class*>(props[kClass])->name;
+  const boost::unordered_map<string,factory>::const_iterator mk
+    = factories.find(class_name);
+  if (mk==factories.end()) throw runtime_error(
+    "undefined histogram class "+class_name
+  );
+
+  if (!props[kBins]) throw runtime_error(
+    "cannot find binning for histogram \""+name+"\""
+  );
+
+  if (mk->second.is2d && !props[kBinsY]) throw runtime_error(
+    "cannot find y binning for histogram \""+name+"\""
+  );
+
+  resolved& r = cache[name];
+  r.mk = mk->second.mk;
+  r.bins = static_cast<const prop_Bins*>(props[kBins]);
+  r.binsy = static_cast<const prop_Bins*>(props[kBinsY]);
+  r.slices = static_cast<const prop_BinnedIn*>(props[kBinnedIn]);
+  for (int j=0;j<nprops;++j) {
+    if (j==kClass || j==kBins || j==kBinsY || j==kBinnedIn) continue;
+    if (props[j]) r.props.push_back(props[j]);
+  }
+
+  return r;
+}
 
 // Constructor ******************************************************
 
 csshists::csshists(const string& cssfilename)
-: _impl( new impl )
+: _impl(nullptr), shared(false)
 {
+  const auto it = preloaded.find(canonical(cssfilename));
+  if (it!=preloaded.end()) {
+    _impl = it->second;
+    shared = true;
+    return;
+  }
+  _impl = new impl;
+
   // Read CSS file
   ifstream css(cssfilename.c_str());
   char c;
@@ -237,16 +397,17 @@ csshists::csshists(const string& cssfilename)
   for (size_t i=0,n=rule_str.size();i<n;++i) {
     if (rule_str[i].second.size()==0) continue; // skip blank rule
 
-    _impl->rules.push_back( make_pair(
-      new const boost::regex( rule_str[i].first ),
-      new prop_map()
-    ) );
-    //_impl->rules.back().second.reserve( rule_str[i].second.size() );
+    impl::rule *r = new impl::rule( rule_str[i].first );
+    _impl->rules.push_back(r);
+
     for (size_t j=0,m=rule_str[i].second.size();j<m;++j) {
       const string& prop_str = rule_str[i].second[j];
       if (prop_str.size()==0) continue; // skip blank property
 
-      _impl->rules.back().second->insert( mkprop( prop_str ) );
+      const pair<prop_t,const prop*> p = mkprop( prop_str );
+      // first definition in a rule takes precedence
+      if (r->props[p.first]) delete p.second;
+      else r->props[p.first] = p.second;
     }
   }
 
@@ -265,76 +426,49 @@ csshists::csshists(const string& cssfilename)
 // Make Historgram **************************************************
 
 TH1* csshists::mkhist(const string& name) const {
-  prop_map props;
-  TH1* h;
-
-  boost::smatch result;
-  for (impl::iter it=_impl->rules.begin(),
-       end=_impl->rules.end();it!=end;++it) {
-    if (boost::regex_match(name, result, *it->first)) {
-      for (prop_map::iterator jt=it->second->begin(),
-           end2=it->second->end();jt!=end2;++jt)
-        props[jt->first] = jt->second;
-    }
-  }
+  const impl::resolved& r = _impl->resolve(name);
 
-  if (!props.size()) throw runtime_error(
-    "no rules matched for histogram \""+name+"\""
-  );
+  TH1* h = r.mk(name,r.bins,r.binsy);
+  for (size_t i=0,n=r.props.size();i<n;++i) r.props[i]->apply(h);
 
-  if (!props.count(kClass)) throw runtime_error(
-    "cannot find class for histogram \""+name+"\""
-  );
-  string class_name(static_cast<const prop_Class*>(props[kClass])->name);
-
-  if (!props.count(kBins)) throw runtime_error(
-    "cannot find binning for histogram \""+name+"\""
-  );
-  if (static_cast<const prop_Bins*>(props[kBins])->isrange) {
-    const prop_Bins_range* b
-      = static_cast<const prop_Bins_range*>(props[kBins]);
-
-    if (!class_name.compare("TH1F")) {
-      h = new TH1F(name.c_str(),"",b->nbinsx,b->xlow,b->xup);
-    } else if (!class_name.compare("TH1D")) {
-      h = new TH1D(name.c_str(),"",b->nbinsx,b->xlow,b->xup);
-    } else if (!class_name.compare("TH1I")) {
-      h = new TH1I(name.c_str(),"",b->nbinsx,b->xlow,b->xup);
-    } else if (!class_name.compare("TH1C")) {
-      h = new TH1C(name.c_str(),"",b->nbinsx,b->xlow,b->xup);
-    } else if (!class_name.compare("TH1S")) {
-      h = new TH1S(name.c_str(),"",b->nbinsx,b->xlow,b->xup);
-    } else throw runtime_error(
-      "undefined histogram class "+class_name
-    );
-
-  } else {
-    const prop_Bin_edges* b
-      = static_cast<const prop_Bin_edges*>(props[kBins]);
-
-    if (!class_name.compare("TH1F")) {
-      h = new TH1F(name.c_str(),"",b->xbins.size()-1,&b->xbins[0]);
-    } else if (!class_name.compare("TH1D")) {
-      h = new TH1D(name.c_str(),"",b->xbins.size()-1,&b->xbins[0]);
-    } else if (!class_name.compare("TH1I")) {
-      h = new TH1I(name.c_str(),"",b->xbins.size()-1,&b->xbins[0]);
-    } else if (!class_name.compare("TH1C")) {
-      h = new TH1C(name.c_str(),"",b->xbins.size()-1,&b->xbins[0]);
-    } else if (!class_name.compare("TH1S")) {
-      h = new TH1S(name.c_str(),"",b->xbins.size()-1,&b->xbins[0]);
-    } else throw runtime_error(
-      "undefined histogram class "+class_name
-    );
-  }
-  props.erase(kClass);
-  props.erase(kBins);
+  return h;
+}
 
-  for (prop_map::iterator it=props.begin(),end=props.end();it!=end;++it)
-    it->second->apply(h);
+vector<TH1*> csshists::mkhists(const vector<string>& names) const {
+  vector<TH1*> hists;
+  hists.reserve(names.size());
+  for (size_t i=0,n=names.size();i<n;++i)
+    hists.push_back( mkhist(names[i]) );
+  return hists;
+}
 
-  return h;
+vector<csshists::binned_in> csshists::slices(const string& name) const {
+  const impl::resolved& r = _impl->resolve(name);
+  if (r.slices) return r.slices->slices;
+  else return { };
 }
 
 // Destructor *******************************************************
 
-csshists::~csshists() { delete _impl; }
+csshists::~csshists() { if (!shared) delete _impl; }
+
+// Preloading *******************************************************
+
+unordered_map<string,csshists::impl*> csshists::preloaded;
+
+// files are found by their absolute path
+string csshists::canonical(const string& cssfilename) {
+  char *path = realpath(cssfilename.c_str(), nullptr);
+  if (!path) return cssfilename;
+  const string str(path);
+  free(path);
+  return str;
+}
+
+void csshists::preload(const string& cssfilename) {
+  const string path = canonical(cssfilename);
+  if (preloaded.count(path)) return;
+  csshists css(path);
+  css.shared = true; // kept for the lifetime of the process
+  preloaded[path] = css._impl;
+}
@@ -2,18 +2,37 @@
 #define kiwi_csshists_h
 
 #include <string>
+#include <vector>
+#include <unordered_map>
 
 class TH1;
 
 class csshists {
   class impl;
   impl *_impl;
+  bool shared;
+
+  static std::unordered_map<std::string,impl*> preloaded;
+  static std::string canonical(const std::string& cssfilename);
 
 public:
   csshists(const std::string& cssfilename);
   ~csshists();
 
+  // Rules of a preloaded file are shared by every csshists
+  // of the same file, e.g. in jobs forked by bhd
+  static void preload(const std::string& cssfilename);
+
+  // Rules are resolved once per histogram name
   TH1* mkhist(const std::string& name) const;
+  std::vector<TH1*> mkhists(const std::vector<std::string>& names) const;
+
+  // BinnedIn property: slices of a histogram in additional variables
+  struct binned_in {
+    bool above; // cumulative thresholds, otherwise exclusive bin edges
+    std::vector<double> edges;
+  };
+  std::vector<binned_in> slices(const std::string& name) const;
 };
 
 #endif
@@ -0,0 +1,67 @@
+#include "prof.hh"
+
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <stdexcept>
+
+using namespace std;
+
+bool prof::on = false;
+prof::stage_t prof::cur = prof::other;
+prof::clock::time_point prof::first, prof::last;
+long long prof::ns[prof::nstages], prof::calls[prof::nstages];
+
+static const char* stage_names[prof::nstages] {
+  "other", "io", "scales", "pdf", "cluster", "fill", "write"
+};
+
+void prof::start() noexcept {
+  for (int i=0;i<nstages;++i) ns[i] = calls[i] = 0;
+  cur = other;
+  first = last = clock::now();
+  on = true;
+}
+
+void prof::prt(ostream& os, long long entries) noexcept {
+  if (!on) return;
+  lap(cur,false);
+  const double total = chrono::duration_cast<chrono::nanoseconds>(
+    last - first ).count();
+
+  os << "\nProfile:" << endl;
+  os << setw(10) << "stage" << setw(12) << "time, s"
+     << setw(8) << '%' << setw(14) << "calls" << endl;
+  for (int i=0;i<nstages;++i) {
+    if (!calls[i] && !ns[i]) continue;
+    os << setw(10) << stage_names[i]
+       << setw(12) << fixed << setprecision(3) << ns[i]*1e-9
+       << setw(8) << setprecision(1) << 100.*ns[i]/total
+       << setw(14) << calls[i] << endl;
+  }
+  os << setw(10) << "total" << setw(12) << setprecision(3) << total*1e-9
+     << endl;
+  os << "Entries: " << entries << ", "
+     << setprecision(1) << entries/(total*1e-9) << " entries/s" << endl;
+  os.unsetf(ios_base::floatfield);
+}
+
+void prof::json(const string& file_name, long long entries) {
+  if (!on) return;
+  lap(cur,false);
+  const double total = chrono::duration_cast<chrono::nanoseconds>(
+    last - first ).count();
+
+  ofstream f(file_name);
+  if (!f) throw runtime_error("cannot write profile to "+file_name);
+
+  f << "{\"stages\":{";
+  for (int i=0;i<nstages;++i) {
+    if (i) f << ',';
+    f << '\"' << stage_names[i] << "\":{\"s\":" << ns[i]*1e-9
+      << ",\"calls\":" << calls[i] << '}';
+  }
+  f << "},\"total_s\":" << total*1e-9
+    << ",\"entries\":" << entries
+    << ",\"entries_per_s\":" << entries/(total*1e-9) << '}' << endl;
+}
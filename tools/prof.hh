@@ -0,0 +1,53 @@
+#ifndef prof_h
+#define prof_h
+
+#include <chrono>
+#include <string>
+#include <iosfwd>
+
+// Wall time spent in each stage of an event loop *******************
+// Time is attributed to the current stage until another one is selected.
+// Nothing is timed unless profiling was started.
+
+class prof {
+public:
+  enum stage_t { other, io, scales, pdf, cluster, fill, write, nstages };
+
+private:
+  typedef std::chrono::steady_clock clock;
+
+  static bool on;
+  static stage_t cur;
+  static clock::time_point first, last;
+  static long long ns[nstages], calls[nstages];
+
+  static void lap(stage_t next, bool count=true) noexcept {
+    const clock::time_point now = clock::now();
+    ns[cur] += std::chrono::duration_cast<std::chrono::nanoseconds>(
+      now - last ).count();
+    last = now;
+    cur = next;
+    if (count) ++calls[next];
+  }
+
+public:
+  static void start() noexcept;
+  static bool enabled() noexcept { return on; }
+
+  // Select current stage
+  static void stage(stage_t s) noexcept { if (on) lap(s); }
+
+  // Select stage for the lifetime of the object
+  class scope {
+    stage_t prev;
+  public:
+    scope(stage_t s) noexcept: prev(cur) { stage(s); }
+    ~scope() { if (on) lap(prev,false); }
+  };
+
+  // Print breakdown of wall time and rate
+  static void prt(std::ostream& os, long long entries) noexcept;
+  static void json(const std::string& file_name, long long entries);
+};
+
+#endif
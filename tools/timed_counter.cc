@@ -2,49 +2,82 @@
 
 #include <iostream>
 #include <iomanip>
+#include <cstdio>
+#include <unistd.h>
 
 using namespace std;
 
-timed_counter::timed_counter(bool newline)
-: seconds(0), minutes(0), hours(0), last_time( time(0) ), newline(newline)
-{ }
-
-void timed_counter::prt(const num_t& ent) const noexcept {
-  cout << setw(10) << ent << " | ";
-  if (hours) {
-    cout << setw(5) << hours << ':'
-    << setfill('0') << setw(2) << minutes << ':'
-    << setw(2) << seconds << setfill(' ');
-  } else if (minutes) {
-    cout << setw(2) << minutes << ':'
-    << setfill('0') << setw(2) << seconds << setfill(' ');
-  } else {
-    cout << setw(2) << seconds <<'s';
+timed_counter::timed_counter(num_t first, num_t end, bool newline)
+: first(first), end(end),
+  lines( newline || !isatty(fileno(stdout)) ),
+  interval( !newline && lines ? 10. : 1. ),
+  count(0), start(clock::now()), last(start), last_count(0), rate(0)
+{
+  busy.clear();
+}
+
+namespace {
+
+void prt_time(double sec) {
+  const unsigned long s = sec;
+  const unsigned long h = s/3600, m = (s/60)%60;
+  if (h) cout << h << ':' << setfill('0') << setw(2) << m << ':';
+  else cout << m << ':' << setfill('0');
+  cout << setw(2) << s%60 << setfill(' ');
+}
+
+void prt_rate(double r) {
+  cout << fixed << setprecision(1);
+  if (r >= 1e6) cout << setw(6) << r*1e-6 << 'M';
+  else if (r >= 1e3) cout << setw(6) << r*1e-3 << 'k';
+  else cout << setw(6) << r << ' ';
+  cout.unsetf(ios_base::floatfield);
+}
+
+}
+
+void timed_counter::prt_line(num_t done, double elapsed, bool final)
+const noexcept {
+  if (!lines) cout << '\r';
+  cout << setw(10) << done;
+  if (end > first) {
+    cout << " / " << (end-first) << ' '
+         << fixed << setprecision(1) << setw(5) << 100.*done/(end-first)
+         << '%';
+    cout.unsetf(ios_base::floatfield);
+  }
+  cout << " | ";
+  prt_time(elapsed);
+  cout << " | ";
+  prt_rate(final ? (elapsed > 0. ? done/elapsed : 0.) : rate);
+  cout << " ent/s";
+  if (!final && end > first && rate > 0.) {
+    cout << " | ETA ";
+    prt_time((end-first-done)/rate);
   }
+  if (!lines) cout << "\033[K"; // clear rest of line
+  if (lines && !final) cout << endl;
+  else cout << flush;
 }
 
-void timed_counter::operator()(const num_t& ent) noexcept {
-  cur_time = time(0);
-  if ( difftime(cur_time,last_time) > 1 ) {
-    prt(ent);
-    if (newline) cout << endl;
-    else {
-      cout.flush();
-      if (hours)        for (char i=0;i<24;i++) cout << '\b';
-      else if (minutes) for (char i=0;i<18;i++) cout << '\b';
-      else              for (char i=0;i<16;i++) cout << '\b';
-    }
-
-    last_time = cur_time;
-    ++seconds;
-    if (seconds==60) {
-      seconds = 0;
-      ++minutes;
-      if (minutes==60) {
-        minutes = 0;
-        ++hours;
-      }
-    }
+void timed_counter::poll(num_t done) noexcept {
+  if (busy.test_and_set(memory_order_acquire)) return;
 
+  const clock::time_point now = clock::now();
+  const double dt = chrono::duration<double>(now - last).count();
+  if (dt >= interval) {
+    const double r = (done - last_count)/dt;
+    rate = (rate > 0. ? 0.7*rate + 0.3*r : r);
+    last = now;
+    last_count = done;
+    prt_line(done, chrono::duration<double>(now - start).count(), false);
   }
+
+  busy.clear(memory_order_release);
+}
+
+void timed_counter::prt(num_t ent) noexcept {
+  const num_t done = (count.load() ? count.load() : ent-first);
+  prt_line(done,
+    chrono::duration<double>(clock::now() - start).count(), true);
 }
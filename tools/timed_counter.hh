@@ -1,18 +1,50 @@
 #ifndef timed_counter_h
 #define timed_counter_h
 
-#include <ctime>
+#include <chrono>
+#include <atomic>
 
 class timed_counter {
-  unsigned short seconds, minutes, hours;
-  time_t last_time, cur_time;
-  bool newline;
+public:
   typedef long num_t;
 
+private:
+  typedef std::chrono::steady_clock clock;
+
+  static constexpr num_t poll_mask = 1023; // check clock every 1024 entries
+
+  const num_t first, end;
+  const bool lines;
+  const double interval; // seconds between printouts
+
+  std::atomic<num_t> count;
+  std::atomic_flag busy;
+  clock::time_point start, last;
+  num_t last_count;
+  double rate; // moving average
+
+  void poll(num_t done) noexcept;
+  void prt_line(num_t done, double elapsed, bool final) const noexcept;
+
 public:
-  timed_counter(bool newline=false);
-  void prt(const num_t& ent) const noexcept;
-  void operator()(const num_t& ent) noexcept;
+  // Entries from first to end are processed
+  // Progress is printed on one line, unless newline is set
+  // or stdout is not a terminal
+  timed_counter(num_t first, num_t end, bool newline=false);
+
+  // Single thread: called with every processed entry
+  void operator()(num_t ent) noexcept {
+    if (((ent-first) & poll_mask) == 0) poll(ent-first);
+  }
+
+  // Any thread: add n processed entries
+  void add(num_t n=1) noexcept {
+    const num_t c = count.fetch_add(n,std::memory_order_relaxed) + n;
+    if ((c & ~poll_mask) != ((c-n) & ~poll_mask)) poll(c);
+  }
+
+  // Print final count, time, and rate
+  void prt(num_t ent) noexcept;
 };
 
 #endif